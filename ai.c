@@ -23,12 +23,143 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "constants.h"
 #include "coord.h"
 #include <stdlib.h>
+#include <string.h>
 
-enum AIDifficulty ai_difficulties[PLAYER_COUNT];
+/// Associates a difficulty with its name.
+struct DifficultyName
+{
+    /// The difficulty.
+    enum AIDifficulty difficulty;
+
+    /// The difficulty's name.
+    const char *name;
+};
+
+/// The names of all difficulties.
+static const struct DifficultyName difficulty_names[] =
+{
+    {AI_NONE, "none"},
+    {AI_EASY, "easy"},
+    {AI_NORMAL, "normal"},
+    {AI_HARD, "hard"},
+    {AI_EXPERT, "expert"}
+};
+
+/// The number of entries in difficulty_names.
+#define DIFFICULTY_COUNT (sizeof(difficulty_names) / sizeof(difficulty_names[0]))
+
+bool ai_parse_difficulty(const char *name, enum AIDifficulty *difficulty)
+{
+    for (size_t i = 0; i < DIFFICULTY_COUNT; ++i)
+    {
+        if (strcmp(name, difficulty_names[i].name) == 0)
+        {
+            *difficulty = difficulty_names[i].difficulty;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *ai_difficulty_name(enum AIDifficulty difficulty)
+{
+    for (size_t i = 0; i < DIFFICULTY_COUNT; ++i)
+    {
+        if (difficulty_names[i].difficulty == difficulty)
+            return difficulty_names[i].name;
+    }
+    return "unknown";
+}
+
+/// Clamps a paddle movement to the maximum speed.
+/// \param[in]  dir The desired movement.
+/// \returns    The player input.
+static PlayerInput clamp_input(int dir)
+{
+    if (dir > PADDLE_MAX_SPEED)
+        dir = PADDLE_MAX_SPEED;
+    else if (dir < -PADDLE_MAX_SPEED)
+        dir = -PADDLE_MAX_SPEED;
+    return dir;
+}
+
+/// Predicts the paddle position needed to return the ball, taking bounces
+/// off the top and bottom edges into account.
+/// \param[in]  ball            The ball.
+/// \param[in]  player_index    The index of the AI player.
+/// \returns    The paddle's target Y coordinate.
+static int predict_target(const struct Ball *ball, size_t player_index)
+{
+    // The X coordinate the ball will have when it reaches the paddle
+    int contact_x = player_index == 0
+        ? coord_from_int(player_x_coords[player_index] + PADDLE_WIDTH)
+        : coord_from_int(player_x_coords[player_index] - BALL_SIZE);
+    int distance = contact_x - ball->x_coord;
+    bool approaching = ball->vel_x != 0
+        && (distance < 0) == (ball->vel_x < 0);
+    if (!approaching)
+    {
+        // Wait in the middle for the ball to come back
+        return TABLE_HEIGHT / 2 - PADDLE_HEIGHT / 2;
+    }
+
+    // Unfold the bounces: the ball's path is a straight line in a space where
+    // the table is mirrored at each edge
+    long frames = distance / ball->vel_x;
+    long range = coord_from_int(TABLE_HEIGHT - BALL_SIZE);
+    long y = (ball->y_coord + frames * ball->vel_y) % (2 * range);
+    if (y < 0)
+        y += 2 * range;
+    if (y > range)
+        y = 2 * range - y;
+
+    return coord_to_int(y) + BALL_SIZE / 2 - PADDLE_HEIGHT / 2;
+}
+
+void ai_init(struct AIPlayer *ai, enum AIDifficulty difficulty)
+{
+    ai->difficulty = difficulty;
+    // No ball has a speed of zero, so the first call calculates a target
+    ai->dir_x = 0;
+    ai->dir_y = 0;
+    ai->speed = 0;
+    ai->target_y = TABLE_HEIGHT / 2 - PADDLE_HEIGHT / 2;
+}
 
-PlayerInput ai_determine_input(const struct GameState *state, size_t player_index)
+/// Calculates an AI_EXPERT player's input. The target position only changes
+/// when the ball bounces, is served or is hit, each of which changes its
+/// direction or speed, so it is only recalculated then.
+/// \param[in]  ai              The AI player's state.
+/// \param[in]  state           The current game state.
+/// \param[in]  player_index    The index of the AI player.
+/// \returns    The AI player's input.
+static PlayerInput expert_input(
+    struct AIPlayer *ai,
+    const struct GameState *state,
+    size_t player_index)
 {
-    enum AIDifficulty difficulty = ai_difficulties[player_index];
+    const struct Ball *ball = &(state->ball);
+    if (ball->dir_x != ai->dir_x
+        || ball->dir_y != ai->dir_y
+        || ball->speed != ai->speed)
+    {
+        ai->dir_x = ball->dir_x;
+        ai->dir_y = ball->dir_y;
+        ai->speed = ball->speed;
+        ai->target_y = predict_target(ball, player_index);
+    }
+    return clamp_input(ai->target_y - state->players[player_index].y);
+}
+
+PlayerInput ai_determine_input(
+    struct AIPlayer *ai,
+    const struct GameState *state,
+    size_t player_index)
+{
+    enum AIDifficulty difficulty = ai->difficulty;
+    if (difficulty == AI_EXPERT)
+        return expert_input(ai, state, player_index);
+
     int x_dist = abs(
         coord_to_int(state->ball.x_coord) + BALL_SIZE / 2
         - (player_x_coords[player_index] + PADDLE_WIDTH / 2));
@@ -38,9 +169,5 @@ PlayerInput ai_determine_input(const struct GameState *state, size_t player_inde
     x_dist /= difficulty;
     if (x_dist > 0)
         dir /= x_dist;
-    if (dir > PADDLE_MAX_SPEED)
-        dir = PADDLE_MAX_SPEED;
-    else if (dir < -PADDLE_MAX_SPEED)
-        dir = -PADDLE_MAX_SPEED;
-    return dir;
+    return clamp_input(dir);
 }
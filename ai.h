@@ -24,6 +24,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "constants.h"
 #include "game.h"
+#include <stdbool.h>
 #include <stddef.h>
 
 /// Represents the "intelligence" of an AI opponent.
@@ -32,16 +33,56 @@ enum AIDifficulty
     AI_NONE = 0,
     AI_EASY = 1,
     AI_NORMAL = 2,
-    AI_HARD = 8
+    AI_HARD = 8,
+
+    /// Predicts where the ball will cross the paddle, including bounces off
+    /// the top and bottom edges, rather than following it.
+    AI_EXPERT = 16
+};
+
+/// The state of an AI-controlled player.
+struct AIPlayer
+{
+    /// The player's difficulty.
+    enum AIDifficulty difficulty;
+
+    /// The ball's horizontal direction when \a target_y was calculated.
+    short dir_x;
+
+    /// The ball's vertical direction when \a target_y was calculated.
+    short dir_y;
+
+    /// The ball's speed when \a target_y was calculated.
+    short speed;
+
+    /// The paddle position that an AI_EXPERT player is moving towards.
+    short target_y;
 };
 
-/// The difficulties of the game's players.
-extern enum AIDifficulty ai_difficulties[PLAYER_COUNT];
+/// Parses the name of a difficulty.
+/// \param[in]  name        The difficulty's name, e.g. "normal".
+/// \param[out] difficulty  Receives the parsed difficulty.
+/// \returns    True if the name was recognized, false otherwise.
+bool ai_parse_difficulty(const char *name, enum AIDifficulty *difficulty);
+
+/// Gets the name of a difficulty.
+/// \param[in]  difficulty  The difficulty.
+/// \returns    The difficulty's name, as accepted by ai_parse_difficulty().
+const char *ai_difficulty_name(enum AIDifficulty difficulty);
+
+/// Initializes an AI player's state.
+/// \param[out] ai          The AI player.
+/// \param[in]  difficulty  The player's difficulty; must not be AI_NONE.
+void ai_init(struct AIPlayer *ai, enum AIDifficulty difficulty);
 
 /// Calculates a player's input in response to the current game state.
+/// \param[in]  ai              The AI player's state.
 /// \param[in]  state           The current game state.
 /// \param[in]  player_index    The index of the AI player.
 /// \returns    The AI player's input.
-PlayerInput ai_determine_input(const struct GameState *state, size_t player_index);
+PlayerInput ai_determine_input(
+    struct AIPlayer *ai,
+    const struct GameState *state,
+    size_t player_index);
 
 #endif
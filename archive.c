@@ -0,0 +1,419 @@
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Implementation of the archive module.
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+// Needed for mmap(), fseeko() and ftello() in strict C99 mode
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "archive.h"
+#include "bytes.h"
+#include "replay.h"
+#include <stdlib.h>
+#include <string.h>
+
+/// The size of the index file's header, in bytes.
+#define INDEX_HEADER_SIZE 16
+
+/// The size of the inputs file's header, in bytes.
+#define INPUTS_HEADER_SIZE 8
+
+/// The version of the archive format written.
+#define ARCHIVE_VERSION 1
+
+/// The longest path accepted, including the file extensions.
+#define MAX_PATH_LENGTH 4096
+
+/// The magic number at the start of the index file.
+static const unsigned char index_magic[4] = {'T', 'T', 'A', 'I'};
+
+/// The magic number at the start of the inputs file.
+static const unsigned char inputs_magic[4] = {'T', 'T', 'A', 'D'};
+
+/// Builds the path of one of an archive's files.
+/// \param[out] buffer      Receives the path; #MAX_PATH_LENGTH bytes.
+/// \param[in]  path        The path of the archive.
+/// \param[in]  extension   The file's extension.
+/// \returns    True if successful, false if the path is too long.
+static bool make_path(char *buffer, const char *path, const char *extension)
+{
+    size_t length = strlen(path);
+    size_t extension_length = strlen(extension);
+    if (length + extension_length + 1 > MAX_PATH_LENGTH)
+        return false;
+    memcpy(buffer, path, length);
+    memcpy(buffer + length, extension, extension_length + 1);
+    return true;
+}
+
+/// Moves to a position in a file.
+/// \param[in]  file        The file.
+/// \param[in]  position    The position, or -1 for the end of the file.
+/// \returns    The new position, or -1 on failure.
+static int64_t seek_file(FILE *file, int64_t position)
+{
+    int origin = position < 0 ? SEEK_END : SEEK_SET;
+    int64_t offset = position < 0 ? 0 : position;
+#ifdef _WIN32
+    if (_fseeki64(file, offset, origin) != 0)
+        return -1;
+    return _ftelli64(file);
+#else
+    if (fseeko(file, (off_t)offset, origin) != 0)
+        return -1;
+    return (int64_t)ftello(file);
+#endif
+}
+
+/// Cuts a file short and moves to its new end.
+/// \param[in]  file    The file.
+/// \param[in]  size    The new size of the file, in bytes.
+/// \returns    True if successful, false otherwise.
+static bool truncate_file(FILE *file, int64_t size)
+{
+    if (fflush(file) != 0)
+        return false;
+#ifdef _WIN32
+    if (_chsize_s(_fileno(file), size) != 0)
+        return false;
+#else
+    if (ftruncate(fileno(file), (off_t)size) != 0)
+        return false;
+#endif
+    return seek_file(file, size) == size;
+}
+
+/// Opens one of an archive's files for appending, writing its header if it
+/// is new or checking it otherwise.
+/// \param[in]  path        The path of the archive.
+/// \param[in]  extension   The file's extension.
+/// \param[in]  header      The file's header.
+/// \param[in]  header_size The size of \a header, in bytes.
+/// \param[out] size        Receives the size of the file, in bytes.
+/// \returns    The file, or NULL on failure.
+static FILE *open_for_append(
+    const char *path,
+    const char *extension,
+    const unsigned char *header,
+    size_t header_size,
+    uint64_t *size)
+{
+    char file_path[MAX_PATH_LENGTH];
+    if (!make_path(file_path, path, extension))
+        return NULL;
+    FILE *file = fopen(file_path, "r+b");
+    if (!file)
+        file = fopen(file_path, "w+b");
+    if (!file)
+        return NULL;
+
+    int64_t end = seek_file(file, -1);
+    bool successful = end >= 0;
+    if (successful && end == 0)
+    {
+        successful = fwrite(header, 1, header_size, file) == header_size;
+        end = (int64_t)header_size;
+    }
+    else if (successful)
+    {
+        unsigned char existing[INDEX_HEADER_SIZE];
+        successful = (uint64_t)end >= header_size
+            && seek_file(file, 0) == 0
+            && fread(existing, 1, header_size, file) == header_size
+            && memcmp(existing, header, header_size) == 0
+            && seek_file(file, end) == end;
+    }
+
+    if (!successful)
+    {
+        fclose(file);
+        return NULL;
+    }
+    *size = (uint64_t)end;
+    return file;
+}
+
+bool ar_create(struct ArchiveWriter *writer, const char *path)
+{
+    unsigned char index_header[INDEX_HEADER_SIZE] = {0};
+    memcpy(index_header, index_magic, sizeof(index_magic));
+    index_header[4] = ARCHIVE_VERSION;
+    index_header[5] = PLAYER_COUNT;
+    bytes_store_le(index_header + 6, AR_RECORD_SIZE, 2);
+    unsigned char inputs_header[INPUTS_HEADER_SIZE] = {0};
+    memcpy(inputs_header, inputs_magic, sizeof(inputs_magic));
+    inputs_header[4] = ARCHIVE_VERSION;
+
+    uint64_t index_size;
+    writer->index = open_for_append(
+        path,
+        ".index",
+        index_header,
+        sizeof(index_header),
+        &index_size);
+    if (!writer->index)
+        return false;
+    writer->inputs = open_for_append(
+        path,
+        ".inputs",
+        inputs_header,
+        sizeof(inputs_header),
+        &writer->inputs_size);
+    if (!writer->inputs)
+    {
+        fclose(writer->index);
+        return false;
+    }
+
+    // Drop a record that was only partly written, for example by a process
+    // that crashed, along with any records whose inputs did not all reach
+    // the inputs file. Records are in the order their inputs were written,
+    // so only the last ones can be affected.
+    int64_t end = (int64_t)(index_size
+        - (index_size - INDEX_HEADER_SIZE) % AR_RECORD_SIZE);
+    bool successful = true;
+    while (end > INDEX_HEADER_SIZE)
+    {
+        unsigned char record[AR_RECORD_SIZE];
+        successful = seek_file(writer->index, end - AR_RECORD_SIZE) >= 0
+            && fread(record, 1, sizeof(record), writer->index) == sizeof(record);
+        if (!successful)
+            break;
+        uint64_t offset = bytes_load_le(record, 8);
+        uint64_t size = bytes_load_le(record + 24, 4);
+        if (offset <= writer->inputs_size
+            && size <= writer->inputs_size - offset)
+        {
+            break;
+        }
+        end -= AR_RECORD_SIZE;
+    }
+    if (successful && (uint64_t)end < index_size)
+        successful = truncate_file(writer->index, end);
+    else if (successful)
+        successful = seek_file(writer->index, end) == end;
+    if (!successful)
+    {
+        ar_finish(writer);
+        return false;
+    }
+    return true;
+}
+
+bool ar_append(
+    struct ArchiveWriter *writer,
+    uint64_t seed,
+    const enum AIDifficulty *difficulties,
+    const struct GameState *final_state,
+    uint32_t ticks,
+    const void *inputs,
+    size_t inputs_size)
+{
+    if (inputs_size > UINT32_MAX)
+        return false;
+
+    // The inputs are written and flushed first, so that a process that
+    // crashes never leaves a record that refers to inputs that were not
+    // written. After a system crash, ar_create() drops any such records.
+    unsigned char record[AR_RECORD_SIZE] = {0};
+    bytes_store_le(record, writer->inputs_size, 8);
+    bytes_store_le(record + 8, seed, 8);
+    bytes_store_le(record + 16, rp_state_hash(final_state), 8);
+    bytes_store_le(record + 24, inputs_size, 4);
+    bytes_store_le(record + 28, ticks, 4);
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        record[32 + i] = (unsigned char)difficulties[i];
+        record[32 + PLAYER_COUNT + i] = final_state->players[i].score;
+    }
+    if (fwrite(inputs, 1, inputs_size, writer->inputs) != inputs_size
+        || fflush(writer->inputs) != 0)
+    {
+        return false;
+    }
+    writer->inputs_size += inputs_size;
+    return fwrite(record, 1, sizeof(record), writer->index) == sizeof(record);
+}
+
+bool ar_finish(struct ArchiveWriter *writer)
+{
+    bool successful = fclose(writer->inputs) == 0;
+    if (fclose(writer->index) != 0)
+        successful = false;
+    writer->inputs = NULL;
+    writer->index = NULL;
+    return successful;
+}
+
+/// Maps a file into memory, read-only.
+/// \param[out] mapping The mapping to initialize.
+/// \param[in]  path    The file.
+/// \returns    True if successful, false otherwise.
+static bool map_file(struct ArchiveMapping *mapping, const char *path)
+{
+    mapping->data = NULL;
+    mapping->size = 0;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(
+        path,
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    HANDLE view = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0
+        && (uint64_t)size.QuadPart <= SIZE_MAX)
+    {
+        view = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    if (view)
+    {
+        // The view keeps the mapping and the file open
+        mapping->data = MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0);
+        mapping->size = (size_t)size.QuadPart;
+        CloseHandle(view);
+    }
+    CloseHandle(file);
+#else
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+        return false;
+    struct stat status;
+    if (fstat(file, &status) == 0 && status.st_size > 0
+        && (uint64_t)status.st_size <= SIZE_MAX)
+    {
+        void *data = mmap(
+            NULL,
+            (size_t)status.st_size,
+            PROT_READ,
+            MAP_SHARED,
+            file,
+            0);
+        if (data != MAP_FAILED)
+        {
+            mapping->data = data;
+            mapping->size = (size_t)status.st_size;
+        }
+    }
+    close(file);
+#endif
+    return mapping->data != NULL;
+}
+
+/// Unmaps a file.
+/// \param[in]  mapping The mapping.
+static void unmap_file(struct ArchiveMapping *mapping)
+{
+    if (!mapping->data)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(mapping->data);
+#else
+    munmap((void *)mapping->data, mapping->size);
+#endif
+    mapping->data = NULL;
+    mapping->size = 0;
+}
+
+bool ar_open(struct Archive *archive, const char *path)
+{
+    memset(archive, 0, sizeof(*archive));
+    char file_path[MAX_PATH_LENGTH];
+    if (!make_path(file_path, path, ".index")
+        || !map_file(&archive->index, file_path))
+    {
+        return false;
+    }
+    if (!make_path(file_path, path, ".inputs")
+        || !map_file(&archive->inputs, file_path))
+    {
+        ar_close(archive);
+        return false;
+    }
+
+    const unsigned char *index = archive->index.data;
+    const unsigned char *inputs = archive->inputs.data;
+    if (archive->index.size < INDEX_HEADER_SIZE
+        || memcmp(index, index_magic, sizeof(index_magic)) != 0
+        || index[4] != ARCHIVE_VERSION
+        || index[5] != PLAYER_COUNT
+        || bytes_load_le(index + 6, 2) != AR_RECORD_SIZE
+        || archive->inputs.size < INPUTS_HEADER_SIZE
+        || memcmp(inputs, inputs_magic, sizeof(inputs_magic)) != 0
+        || inputs[4] != ARCHIVE_VERSION)
+    {
+        ar_close(archive);
+        return false;
+    }
+
+    archive->count = (archive->index.size - INDEX_HEADER_SIZE) / AR_RECORD_SIZE;
+    return true;
+}
+
+bool ar_match(const struct Archive *archive, size_t index, struct ArchiveMatch *match)
+{
+    if (index >= archive->count)
+        return false;
+
+    const unsigned char *record =
+        archive->index.data + INDEX_HEADER_SIZE + index * AR_RECORD_SIZE;
+    uint64_t offset = bytes_load_le(record, 8);
+    uint64_t size = bytes_load_le(record + 24, 4);
+    if (offset < INPUTS_HEADER_SIZE
+        || offset > archive->inputs.size
+        || size > archive->inputs.size - offset)
+    {
+        return false;
+    }
+
+    match->seed = bytes_load_le(record + 8, 8);
+    match->final_hash = bytes_load_le(record + 16, 8);
+    match->ticks = (uint32_t)bytes_load_le(record + 28, 4);
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        match->difficulties[i] = (enum AIDifficulty)record[32 + i];
+        match->scores[i] = record[32 + PLAYER_COUNT + i];
+    }
+    match->inputs = archive->inputs.data + offset;
+    match->inputs_size = (size_t)size;
+    return true;
+}
+
+void ar_close(struct Archive *archive)
+{
+    unmap_file(&archive->index);
+    unmap_file(&archive->inputs);
+    archive->count = 0;
+}
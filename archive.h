@@ -0,0 +1,167 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Functionality exported by the archive module.
+///
+/// An archive stores any number of matches in two append-only files. The
+/// index file, `<path>.index`, is a 16 byte header followed by one
+/// #AR_RECORD_SIZE byte record per match. The inputs file, `<path>.inputs`,
+/// is an 8 byte header followed by each match's runs, as recorded by a
+/// replay writer from rp_init_memory(). All numbers are little-endian.
+///
+/// | Offset | Size   | Record contents                               |
+/// |--------|--------|-----------------------------------------------|
+/// | 0      | 8      | The offset of the match's runs in the inputs  |
+/// | 8      | 8      | The seed passed to g_init()                   |
+/// | 16     | 8      | rp_state_hash() of the final state            |
+/// | 24     | 4      | The size of the match's runs, in bytes        |
+/// | 28     | 4      | The number of ticks                           |
+/// | 32     | 1 each | Each player's AIDifficulty                    |
+/// | 34     | 1 each | Each player's final score                     |
+/// | 36     | 4      | Reserved, zero                                |
+///
+/// Readers map both files into memory and read records in place, so walking
+/// the matches neither copies nor allocates anything.
+
+#include "ai.h"
+#include "game.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/// The size of a match's record in the index file, in bytes.
+#define AR_RECORD_SIZE 40
+
+/// Appends matches to an archive.
+struct ArchiveWriter
+{
+    /// The index file.
+    FILE *index;
+
+    /// The inputs file.
+    FILE *inputs;
+
+    /// The size of the inputs file, in bytes.
+    uint64_t inputs_size;
+};
+
+/// A file mapped into memory.
+struct ArchiveMapping
+{
+    /// The file's contents.
+    const unsigned char *data;
+
+    /// The size of the file, in bytes.
+    size_t size;
+};
+
+/// An archive mapped into memory for reading.
+struct Archive
+{
+    /// The number of matches.
+    size_t count;
+
+    /// The index file.
+    struct ArchiveMapping index;
+
+    /// The inputs file.
+    struct ArchiveMapping inputs;
+};
+
+/// A match in an archive. The inputs point into the archive's memory.
+struct ArchiveMatch
+{
+    /// The seed passed to g_init().
+    uint64_t seed;
+
+    /// rp_state_hash() of the final state.
+    uint64_t final_hash;
+
+    /// The number of ticks.
+    uint32_t ticks;
+
+    /// The players' difficulties.
+    enum AIDifficulty difficulties[PLAYER_COUNT];
+
+    /// The players' final scores.
+    unsigned char scores[PLAYER_COUNT];
+
+    /// The match's runs, to read with rp_open_runs().
+    const unsigned char *inputs;
+
+    /// The size of \a inputs, in bytes.
+    size_t inputs_size;
+};
+
+/// Opens an archive for appending, creating it if it does not exist. Records
+/// left behind by a crash, whether partly written or referring to inputs that
+/// never reached the inputs file, are removed.
+/// \param[out] writer  The writer to initialize.
+/// \param[in]  path    The path of the archive, without the file extensions.
+/// \returns    True if successful, false otherwise.
+bool ar_create(struct ArchiveWriter *writer, const char *path);
+
+/// Appends a match to an archive. This must not be called by more than one
+/// thread at a time.
+/// \param[in,out]  writer          The writer.
+/// \param[in]      seed            The seed passed to g_init().
+/// \param[in]      difficulties    The players' difficulties.
+/// \param[in]      final_state     The state after the last tick.
+/// \param[in]      ticks           The number of ticks.
+/// \param[in]      inputs          The match's runs.
+/// \param[in]      inputs_size     The size of \a inputs, in bytes.
+/// \returns    True if successful, false otherwise.
+bool ar_append(
+    struct ArchiveWriter *writer,
+    uint64_t seed,
+    const enum AIDifficulty *difficulties,
+    const struct GameState *final_state,
+    uint32_t ticks,
+    const void *inputs,
+    size_t inputs_size);
+
+/// Closes an archive that was opened for appending.
+/// \param[in,out]  writer  The writer.
+/// \returns    True if everything was written, false otherwise.
+bool ar_finish(struct ArchiveWriter *writer);
+
+/// Maps an archive into memory for reading. A record that was only partly
+/// written, for example by a process that crashed, is ignored.
+/// \param[out] archive The archive to initialize.
+/// \param[in]  path    The path of the archive, without the file extensions.
+/// \returns    True if successful, false otherwise.
+bool ar_open(struct Archive *archive, const char *path);
+
+/// Reads a match's record. This is safe to call from any number of threads.
+/// \param[in]  archive The archive.
+/// \param[in]  index   The index of the match.
+/// \param[out] match   Receives the match.
+/// \returns    True if successful, false if the record points outside the
+///             inputs file.
+bool ar_match(const struct Archive *archive, size_t index, struct ArchiveMatch *match);
+
+/// Unmaps an archive.
+/// \param[in]  archive The archive.
+void ar_close(struct Archive *archive);
+
+#endif
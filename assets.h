@@ -0,0 +1,42 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Files compiled into the executable.
+///
+/// The build generates a source file for each asset with embed.cmake, so
+/// the game does not have to find or read anything on disk when it starts.
+
+#include <stddef.h>
+
+/// The contents of sounds/bounce.wav.
+extern const unsigned char as_bounce_wav[];
+
+/// The size of #as_bounce_wav, in bytes.
+extern const size_t as_bounce_wav_size;
+
+/// The contents of sounds/score.wav.
+extern const unsigned char as_score_wav[];
+
+/// The size of #as_score_wav, in bytes.
+extern const size_t as_score_wav_size;
+
+#endif
@@ -0,0 +1,327 @@
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Implementation of the batched gameplay module.
+///
+/// Games are updated several at a time using SSE2 or AVX2, whichever the
+/// compiler is targeting. Moving the ball and bouncing it off the top and
+/// bottom edges is done without branches in every lane. Scoring and paddle
+/// hits are rare, so lanes where one of them happens are rewound and passed
+/// to g_update() instead.
+
+#include "batch.h"
+#include "coord.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+/// The number of games updated at once.
+#define LANES 8
+
+typedef __m256i VecInt;
+#define vec_load(p) _mm256_loadu_si256((const __m256i *)(p))
+#define vec_store(p, v) _mm256_storeu_si256((__m256i *)(p), (v))
+#define vec_set1 _mm256_set1_epi32
+#define vec_add _mm256_add_epi32
+#define vec_sub _mm256_sub_epi32
+#define vec_and _mm256_and_si256
+#define vec_or _mm256_or_si256
+#define vec_andnot _mm256_andnot_si256
+#define vec_xor _mm256_xor_si256
+#define vec_cmpgt _mm256_cmpgt_epi32
+#define vec_srai _mm256_srai_epi32
+#define vec_movemask(v) _mm256_movemask_ps(_mm256_castsi256_ps(v))
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+/// The number of games updated at once.
+#define LANES 4
+
+typedef __m128i VecInt;
+#define vec_load(p) _mm_loadu_si128((const __m128i *)(p))
+#define vec_store(p, v) _mm_storeu_si128((__m128i *)(p), (v))
+#define vec_set1 _mm_set1_epi32
+#define vec_add _mm_add_epi32
+#define vec_sub _mm_sub_epi32
+#define vec_and _mm_and_si128
+#define vec_or _mm_or_si128
+#define vec_andnot _mm_andnot_si128
+#define vec_xor _mm_xor_si128
+#define vec_cmpgt _mm_cmpgt_epi32
+#define vec_srai _mm_srai_epi32
+#define vec_movemask(v) _mm_movemask_ps(_mm_castsi128_ps(v))
+
+#endif
+
+/// The base 2 logarithm of COORD_SCALE, used to convert fixed-point values to
+/// integers with a shift. The shift only matches coord_to_int() for
+/// non-negative values, which are the only ones it is used on.
+#define COORD_SHIFT 4
+
+#if (1 << COORD_SHIFT) != COORD_SCALE
+#error "COORD_SHIFT does not match COORD_SCALE"
+#endif
+
+#ifdef LANES
+
+/// Selects lanes from one of two vectors.
+/// \param[in]  mask    All bits set in lanes where \a a should be selected,
+///                     and clear where \a b should be.
+/// \param[in]  a       The first vector.
+/// \param[in]  b       The second vector.
+/// \returns    The selected lanes.
+static inline VecInt vec_select(VecInt mask, VecInt a, VecInt b)
+{
+    return vec_or(vec_and(mask, a), vec_andnot(mask, b));
+}
+
+/// Negates the lanes selected by a mask.
+/// \param[in]  mask    All bits set in lanes that should be negated.
+/// \param[in]  v       The input vector.
+/// \returns    The result.
+static inline VecInt vec_negate_if(VecInt mask, VecInt v)
+{
+    return vec_sub(vec_xor(v, mask), mask);
+}
+
+/// Clamps each lane to a range.
+/// \param[in]  v   The input vector.
+/// \param[in]  lo  The lower bound.
+/// \param[in]  hi  The upper bound.
+/// \returns    The clamped values.
+static inline VecInt vec_clamp(VecInt v, VecInt lo, VecInt hi)
+{
+    v = vec_select(vec_cmpgt(lo, v), lo, v);
+    return vec_select(vec_cmpgt(v, hi), hi, v);
+}
+
+/// Determines which lanes have the ball colliding with a paddle.
+/// \param[in]  pad_x   The paddle's X coordinate.
+/// \param[in]  pad_y   The paddles' Y coordinates.
+/// \param[in]  ball_x  The balls' X coordinates.
+/// \param[in]  ball_y  The balls' Y coordinates.
+/// \returns    All bits set in lanes where the ball and paddle are colliding.
+static inline VecInt vec_paddle_collide(int pad_x, VecInt pad_y, VecInt ball_x, VecInt ball_y)
+{
+    VecInt x = vec_set1(pad_x);
+    VecInt collide = vec_cmpgt(vec_add(ball_x, vec_set1(BALL_SIZE)), x);
+    collide = vec_and(collide,
+        vec_cmpgt(vec_add(x, vec_set1(PADDLE_WIDTH)), ball_x));
+    collide = vec_and(collide,
+        vec_cmpgt(vec_add(ball_y, vec_set1(BALL_SIZE)), pad_y));
+    collide = vec_and(collide,
+        vec_cmpgt(vec_add(pad_y, vec_set1(PADDLE_HEIGHT)), ball_y));
+    return collide;
+}
+
+/// Updates LANES consecutive games by one frame.
+/// \param[in]  batch   The batch.
+/// \param[in]  first   The index of the first game to update.
+/// \param[in]  inputs  The players' inputs for the whole batch.
+static void update_lanes(struct GameBatch *batch, size_t first, const PlayerInput *inputs)
+{
+    const VecInt zero = vec_set1(0);
+
+    VecInt paddles[PLAYER_COUNT];
+    for (size_t p = 0; p < PLAYER_COUNT; ++p)
+    {
+        int lane_inputs[LANES];
+        for (size_t l = 0; l < LANES; ++l)
+            lane_inputs[l] = inputs[(first + l) * PLAYER_COUNT + p];
+        VecInt y = vec_add(
+            vec_load(batch->paddle_y[p] + first),
+            vec_load(lane_inputs));
+        paddles[p] = vec_clamp(y, zero, vec_set1(TABLE_HEIGHT - PADDLE_HEIGHT));
+    }
+
+    VecInt dir_y = vec_load(batch->dir_y + first);
+    VecInt vel_y = vec_load(batch->vel_y + first);
+    VecInt new_x = vec_add(
+        vec_load(batch->ball_x + first),
+        vec_load(batch->vel_x + first));
+    VecInt new_y = vec_add(vec_load(batch->ball_y + first), vel_y);
+
+    // Left and right edge collisions
+    VecInt special = vec_cmpgt(zero, new_x);
+    special = vec_or(special, vec_cmpgt(
+        vec_add(vec_srai(new_x, COORD_SHIFT), vec_set1(BALL_SIZE)),
+        vec_set1(TABLE_WIDTH)));
+
+    // Top edge collision
+    VecInt top = vec_cmpgt(zero, new_y);
+    new_y = vec_andnot(top, new_y);
+
+    // Bottom edge collision
+    VecInt bottom = vec_cmpgt(
+        vec_add(vec_srai(new_y, COORD_SHIFT), vec_set1(BALL_SIZE)),
+        vec_set1(TABLE_HEIGHT));
+    new_y = vec_select(bottom,
+        vec_set1(coord_from_int(TABLE_HEIGHT - BALL_SIZE)),
+        new_y);
+    VecInt bounce = vec_xor(top, bottom);
+    dir_y = vec_negate_if(bounce, dir_y);
+    vel_y = vec_negate_if(bounce, vel_y);
+
+    // Paddle collisions
+    VecInt ball_x = vec_srai(new_x, COORD_SHIFT);
+    VecInt ball_y = vec_srai(new_y, COORD_SHIFT);
+    for (size_t p = 0; p < PLAYER_COUNT; ++p)
+    {
+        special = vec_or(special, vec_paddle_collide(
+            player_x_coords[p], paddles[p], ball_x, ball_y));
+    }
+
+    // Save the original state of lanes that need the full update
+    int special_mask = vec_movemask(special);
+    struct GameState special_states[LANES];
+    for (size_t l = 0; l < LANES; ++l)
+    {
+        if (special_mask & (1 << l))
+            gb_store(batch, first + l, &special_states[l]);
+    }
+
+    for (size_t p = 0; p < PLAYER_COUNT; ++p)
+        vec_store(batch->paddle_y[p] + first, paddles[p]);
+    vec_store(batch->ball_x + first, new_x);
+    vec_store(batch->ball_y + first, new_y);
+    vec_store(batch->dir_y + first, dir_y);
+    vec_store(batch->vel_y + first, vel_y);
+
+    for (size_t l = 0; l < LANES; ++l)
+    {
+        if (special_mask & (1 << l))
+        {
+            g_update(&special_states[l], inputs + (first + l) * PLAYER_COUNT, NULL);
+            gb_load(batch, first + l, &special_states[l]);
+        }
+    }
+}
+
+#endif
+
+bool gb_init(struct GameBatch *batch, size_t count, uint64_t seed)
+{
+    memset(batch, 0, sizeof(*batch));
+    batch->count = count;
+    if (count == 0)
+        return true;
+
+    size_t size = count * sizeof(int);
+    batch->ball_x = malloc(size);
+    batch->ball_y = malloc(size);
+    batch->dir_x = malloc(size);
+    batch->dir_y = malloc(size);
+    batch->speed = malloc(size);
+    batch->vel_x = malloc(size);
+    batch->vel_y = malloc(size);
+    batch->rng = malloc(count * sizeof(struct Rng));
+    bool allocated = batch->ball_x && batch->ball_y && batch->dir_x
+        && batch->dir_y && batch->speed && batch->vel_x && batch->vel_y
+        && batch->rng;
+    for (size_t p = 0; p < PLAYER_COUNT; ++p)
+    {
+        batch->paddle_y[p] = malloc(size);
+        batch->score[p] = malloc(count);
+        allocated = allocated && batch->paddle_y[p] && batch->score[p];
+    }
+    if (!allocated)
+    {
+        gb_free(batch);
+        return false;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        struct GameState state;
+        g_init(&state, seed + i);
+        gb_load(batch, i, &state);
+    }
+    return true;
+}
+
+void gb_free(struct GameBatch *batch)
+{
+    free(batch->ball_x);
+    free(batch->ball_y);
+    free(batch->dir_x);
+    free(batch->dir_y);
+    free(batch->speed);
+    free(batch->vel_x);
+    free(batch->vel_y);
+    free(batch->rng);
+    for (size_t p = 0; p < PLAYER_COUNT; ++p)
+    {
+        free(batch->paddle_y[p]);
+        free(batch->score[p]);
+    }
+    memset(batch, 0, sizeof(*batch));
+}
+
+void gb_load(struct GameBatch *batch, size_t index, const struct GameState *state)
+{
+    batch->ball_x[index] = state->ball.x_coord;
+    batch->ball_y[index] = state->ball.y_coord;
+    batch->dir_x[index] = state->ball.dir_x;
+    batch->dir_y[index] = state->ball.dir_y;
+    batch->speed[index] = state->ball.speed;
+    batch->vel_x[index] = state->ball.vel_x;
+    batch->vel_y[index] = state->ball.vel_y;
+    for (size_t p = 0; p < PLAYER_COUNT; ++p)
+    {
+        batch->paddle_y[p][index] = state->players[p].y;
+        batch->score[p][index] = state->players[p].score;
+    }
+    batch->rng[index] = state->rng;
+}
+
+void gb_store(const struct GameBatch *batch, size_t index, struct GameState *state)
+{
+    state->ball.x_coord = batch->ball_x[index];
+    state->ball.y_coord = batch->ball_y[index];
+    state->ball.dir_x = batch->dir_x[index];
+    state->ball.dir_y = batch->dir_y[index];
+    state->ball.speed = batch->speed[index];
+    state->ball.vel_x = batch->vel_x[index];
+    state->ball.vel_y = batch->vel_y[index];
+    for (size_t p = 0; p < PLAYER_COUNT; ++p)
+    {
+        state->players[p].y = batch->paddle_y[p][index];
+        state->players[p].score = batch->score[p][index];
+    }
+    state->rng = batch->rng[index];
+}
+
+void gb_update(struct GameBatch *batch, const PlayerInput *inputs)
+{
+    size_t i = 0;
+#ifdef LANES
+    for (; i + LANES <= batch->count; i += LANES)
+        update_lanes(batch, i, inputs);
+#endif
+    for (; i < batch->count; ++i)
+    {
+        struct GameState state;
+        gb_store(batch, i, &state);
+        g_update(&state, inputs + i * PLAYER_COUNT, NULL);
+        gb_load(batch, i, &state);
+    }
+}
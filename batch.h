@@ -0,0 +1,101 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Functionality exported by the batched gameplay module.
+
+#include "constants.h"
+#include "game.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// A set of independent games, stored as a structure of arrays so that many
+/// games can be updated at once. Element \a i of every array belongs to game
+/// \a i.
+struct GameBatch
+{
+    /// The number of games in the batch.
+    size_t count;
+
+    /// The balls' horizontal positions.
+    int *ball_x;
+
+    /// The balls' vertical positions.
+    int *ball_y;
+
+    /// The balls' horizontal directions.
+    int *dir_x;
+
+    /// The balls' vertical directions.
+    int *dir_y;
+
+    /// The balls' speeds.
+    int *speed;
+
+    /// The balls' horizontal velocities.
+    int *vel_x;
+
+    /// The balls' vertical velocities.
+    int *vel_y;
+
+    /// The vertical positions of each player's paddles.
+    int *paddle_y[PLAYER_COUNT];
+
+    /// Each player's scores.
+    unsigned char *score[PLAYER_COUNT];
+
+    /// The games' random number generators.
+    struct Rng *rng;
+};
+
+/// Allocates a batch of games and initializes each of them with g_init().
+/// \param[out] batch   The batch to initialize.
+/// \param[in]  count   The number of games in the batch.
+/// \param[in]  seed    The seed for the first game; game \a i is seeded with
+///                     `seed + i`.
+/// \returns    True if successful, false if memory could not be allocated.
+bool gb_init(struct GameBatch *batch, size_t count, uint64_t seed);
+
+/// Releases the memory used by a batch.
+/// \param[in]  batch   The batch to free.
+void gb_free(struct GameBatch *batch);
+
+/// Copies a game's state into a batch.
+/// \param[out] batch   The batch.
+/// \param[in]  index   The index of the game within the batch.
+/// \param[in]  state   The state to copy.
+void gb_load(struct GameBatch *batch, size_t index, const struct GameState *state);
+
+/// Copies a game's state out of a batch.
+/// \param[in]  batch   The batch.
+/// \param[in]  index   The index of the game within the batch.
+/// \param[out] state   Receives the game's state.
+void gb_store(const struct GameBatch *batch, size_t index, struct GameState *state);
+
+/// Updates every game in a batch by one frame. The result for each game is
+/// identical to calling g_update() on it, but events are not reported.
+/// \param[in]  batch   The batch to update.
+/// \param[in]  inputs  The players' inputs; the inputs for game \a i start at
+///                     `inputs[i * PLAYER_COUNT]`.
+void gb_update(struct GameBatch *batch, const PlayerInput *inputs);
+
+#endif
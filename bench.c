@@ -0,0 +1,337 @@
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Entry point for the benchmark program.
+///
+/// Every benchmark runs a fixed scenario derived from the same seed, so
+/// results from different builds can be compared directly. The results are
+/// written to standard output as JSON.
+
+#include "ai.h"
+#include "game.h"
+#include "observe.h"
+#include "renderer.h"
+#include "util.h"
+#include <SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// The seed used by every benchmark scenario.
+#define BENCH_SEED 20211
+
+/// The number of frames recorded from the benchmark match.
+#define RECORDED_FRAMES 4096
+
+/// The number of times the simulation benchmarks run through their scenario.
+#define SIMULATION_PASSES 2000
+
+/// The number of times the rendering benchmark runs through its scenario.
+#define RENDER_PASSES 4
+
+/// The width and height of the observations benchmarked.
+#define OBSERVATION_SIZE 84
+
+/// The help text displayed when the `--help` option is provided.
+static const char * const help_text =
+"Runs the benchmarks and writes the results to standard output as JSON.\n"
+"\n"
+"Options:\n"
+"--filter=<text>\tOnly runs benchmarks whose names contain <text>\n";
+
+/// A benchmark.
+struct Benchmark
+{
+    /// The benchmark's name.
+    const char *name;
+
+    /// Prepares for the benchmark outside of the timed runs, or NULL if no
+    /// preparation is needed.
+    /// \returns    True if successful, false otherwise.
+    bool (*setup)(void);
+
+    /// Runs the benchmark's scenario once.
+    /// \returns    The number of operations performed, or zero on failure.
+    unsigned long (*run)(void);
+};
+
+/// Inputs recorded from the benchmark match.
+static PlayerInput recorded_inputs[RECORDED_FRAMES][PLAYER_COUNT];
+
+/// The game's state at the start of each recorded frame.
+static struct GameState recorded_states[RECORDED_FRAMES];
+
+/// Receives an observation of each recorded state.
+static uint8_t observations[RECORDED_FRAMES][OBSERVATION_SIZE][OBSERVATION_SIZE];
+
+/// Prevents the compiler from discarding the benchmarks' results.
+static volatile unsigned long sink;
+
+/// Records the inputs and states of a normal vs hard AI match.
+static void record_match(void)
+{
+    struct AIPlayer ai_players[PLAYER_COUNT];
+    ai_init(&ai_players[0], AI_NORMAL);
+    ai_init(&ai_players[1], AI_HARD);
+    struct GameState state;
+    g_init(&state, BENCH_SEED);
+    for (size_t frame = 0; frame < RECORDED_FRAMES; ++frame)
+    {
+        recorded_states[frame] = state;
+        for (size_t i = 0; i < PLAYER_COUNT; ++i)
+        {
+            recorded_inputs[frame][i] =
+                ai_determine_input(&ai_players[i], &state, i);
+        }
+        g_update(&state, recorded_inputs[frame], NULL);
+    }
+}
+
+/// Benchmarks g_update() by replaying the recorded inputs.
+/// \returns    The number of frames simulated.
+static unsigned long bench_g_update(void)
+{
+    for (int pass = 0; pass < SIMULATION_PASSES; ++pass)
+    {
+        struct GameState state = recorded_states[0];
+        for (size_t frame = 0; frame < RECORDED_FRAMES; ++frame)
+            g_update(&state, recorded_inputs[frame], NULL);
+        sink += state.ball.x_coord;
+    }
+    return (unsigned long)SIMULATION_PASSES * RECORDED_FRAMES;
+}
+
+/// Benchmarks g_advance() with both players idle, which is the best case for
+/// skipping frames.
+/// \returns    The number of frames advanced.
+static unsigned long bench_g_advance(void)
+{
+    const PlayerInput idle[PLAYER_COUNT] = {0};
+    for (int pass = 0; pass < SIMULATION_PASSES; ++pass)
+    {
+        struct GameState state = recorded_states[0];
+        g_advance(&state, idle, RECORDED_FRAMES, NULL);
+        sink += state.ball.x_coord;
+    }
+    return (unsigned long)SIMULATION_PASSES * RECORDED_FRAMES;
+}
+
+/// Benchmarks g_reset_ball().
+/// \returns    The number of serves.
+static unsigned long bench_g_reset_ball(void)
+{
+    struct GameState state = recorded_states[0];
+    for (int pass = 0; pass < SIMULATION_PASSES; ++pass)
+    {
+        for (size_t i = 0; i < RECORDED_FRAMES; ++i)
+            g_reset_ball(&state, i % 2 ? 1 : -1);
+        sink += state.ball.dir_x;
+    }
+    return (unsigned long)SIMULATION_PASSES * RECORDED_FRAMES;
+}
+
+/// Benchmarks ai_determine_input() for both players of the recorded match.
+/// \param[in]  difficulty  The AI players' difficulty.
+/// \returns    The number of inputs calculated.
+static unsigned long bench_ai(enum AIDifficulty difficulty)
+{
+    for (int pass = 0; pass < SIMULATION_PASSES; ++pass)
+    {
+        struct AIPlayer ai_players[PLAYER_COUNT];
+        for (size_t i = 0; i < PLAYER_COUNT; ++i)
+            ai_init(&ai_players[i], difficulty);
+        for (size_t frame = 0; frame < RECORDED_FRAMES; ++frame)
+        {
+            for (size_t i = 0; i < PLAYER_COUNT; ++i)
+            {
+                sink += ai_determine_input(
+                    &ai_players[i],
+                    &recorded_states[frame],
+                    i);
+            }
+        }
+    }
+    return (unsigned long)SIMULATION_PASSES * RECORDED_FRAMES * PLAYER_COUNT;
+}
+
+/// Benchmarks ai_determine_input() for normal AI players.
+/// \returns    The number of inputs calculated.
+static unsigned long bench_ai_normal(void)
+{
+    return bench_ai(AI_NORMAL);
+}
+
+/// Benchmarks ai_determine_input() for expert AI players.
+/// \returns    The number of inputs calculated.
+static unsigned long bench_ai_expert(void)
+{
+    return bench_ai(AI_EXPERT);
+}
+
+/// Initializes the renderer offscreen with the SDL backend.
+/// \returns    True if successful, false otherwise.
+static bool setup_sdl_renderer(void)
+{
+    r_quit();
+    return r_init_offscreen(R_BACKEND_SDL);
+}
+
+/// Initializes the renderer offscreen with the software backend.
+/// \returns    True if successful, false otherwise.
+static bool setup_software_renderer(void)
+{
+    r_quit();
+    return r_init_offscreen(R_BACKEND_SOFTWARE);
+}
+
+/// Benchmarks r_draw_frame() by drawing the recorded states offscreen with
+/// whichever backend was set up.
+/// \returns    The number of frames drawn, or zero on failure.
+static unsigned long bench_r_draw_frame(void)
+{
+    for (int pass = 0; pass < RENDER_PASSES; ++pass)
+    {
+        for (size_t frame = 0; frame < RECORDED_FRAMES; ++frame)
+        {
+            if (!r_draw_frame(&recorded_states[frame]) || !r_present())
+                return 0;
+        }
+    }
+    return (unsigned long)RENDER_PASSES * RECORDED_FRAMES;
+}
+
+/// Benchmarks obs_render() by observing every recorded state at once, using
+/// one thread per CPU.
+/// \returns    The number of observations drawn, or zero on failure.
+static unsigned long bench_obs_render(void)
+{
+    for (int pass = 0; pass < RENDER_PASSES; ++pass)
+    {
+        if (!obs_render(
+            recorded_states,
+            RECORDED_FRAMES,
+            OBSERVATION_SIZE,
+            OBSERVATION_SIZE,
+            0,
+            &observations[0][0][0]))
+        {
+            return 0;
+        }
+        sink += observations[RECORDED_FRAMES - 1][0][0];
+    }
+    return (unsigned long)RENDER_PASSES * RECORDED_FRAMES;
+}
+
+/// All benchmarks.
+static const struct Benchmark benchmarks[] =
+{
+    {"g_update", NULL, bench_g_update},
+    {"g_advance", NULL, bench_g_advance},
+    {"g_reset_ball", NULL, bench_g_reset_ball},
+    {"ai_determine_input/normal", NULL, bench_ai_normal},
+    {"ai_determine_input/expert", NULL, bench_ai_expert},
+    {"r_draw_frame", setup_sdl_renderer, bench_r_draw_frame},
+    {"r_draw_frame/software", setup_software_renderer, bench_r_draw_frame},
+    {"obs_render/84x84", NULL, bench_obs_render}
+};
+
+/// The number of entries in benchmarks.
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/// Runs a benchmark and writes its result as a JSON object.
+/// \param[in]  benchmark   The benchmark.
+/// \param[in]  first       Whether this is the first result written.
+/// \returns    True if successful, false otherwise.
+static bool run_benchmark(const struct Benchmark *benchmark, bool first)
+{
+    if (benchmark->setup && !benchmark->setup())
+        return false;
+
+    // Warm up caches and branch predictors before timing
+    if (!benchmark->run())
+        return false;
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    unsigned long ops = benchmark->run();
+    Uint64 ticks = SDL_GetPerformanceCounter() - start;
+    if (!ops)
+        return false;
+
+    double seconds = (double)ticks / SDL_GetPerformanceFrequency();
+    printf("%s    {\"name\": \"%s\", \"ops\": %lu, \"ns_per_op\": %.3f, "
+        "\"ops_per_sec\": %.1f}",
+        first ? "" : ",\n",
+        benchmark->name,
+        ops,
+        seconds * 1e9 / ops,
+        seconds > 0.0 ? ops / seconds : 0.0);
+    return true;
+}
+
+/// Program entry point.
+/// \param[in]  argc    The number of arguments.
+/// \param[in]  argv    The argument values.
+/// \returns    The exit status.
+int main(int argc, char **argv)
+{
+    const char *filter = "";
+    for (int i = 1; i < argc; ++i)
+    {
+        if (u_starts_with(argv[i], "--filter="))
+        {
+            filter = argv[i] + strlen("--filter=");
+        }
+        else if (strcmp(argv[i], "--help") == 0)
+        {
+            puts(help_text);
+            return EXIT_SUCCESS;
+        }
+        else
+        {
+            fprintf(stderr, "%s: Unrecognized option '%s'\n", argv[0], argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    atexit(r_quit);
+    record_match();
+
+    printf("{\n  \"seed\": %d,\n  \"benchmarks\": [\n", BENCH_SEED);
+    bool first = true;
+    bool successful = true;
+    for (size_t i = 0; i < BENCHMARK_COUNT; ++i)
+    {
+        if (!strstr(benchmarks[i].name, filter))
+            continue;
+        if (!run_benchmark(&benchmarks[i], first))
+        {
+            fprintf(stderr, "Benchmark '%s' failed\n", benchmarks[i].name);
+            successful = false;
+            break;
+        }
+        first = false;
+    }
+
+    // The output stays valid JSON when a benchmark fails, holding the
+    // results up to that point
+    printf("\n  ]\n}\n");
+    return successful ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,52 @@
+#ifndef BYTES_H
+#define BYTES_H
+
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Functions for storing numbers in byte buffers.
+///
+/// Every file format and packet the game writes stores its numbers in
+/// little-endian order, whatever the byte order of the machine.
+
+#include <stdint.h>
+
+/// Stores a number in little-endian order.
+/// \param[out] bytes   Receives the number.
+/// \param[in]  value   The number.
+/// \param[in]  size    The number of bytes to store.
+static inline void bytes_store_le(unsigned char *bytes, uint64_t value, int size)
+{
+    for (int i = 0; i < size; ++i)
+        bytes[i] = (unsigned char)(value >> (i * 8));
+}
+
+/// Loads a number stored in little-endian order.
+/// \param[in]  bytes   The number's bytes.
+/// \param[in]  size    The number of bytes.
+/// \returns    The number.
+static inline uint64_t bytes_load_le(const unsigned char *bytes, int size)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < size; ++i)
+        value |= (uint64_t)bytes[i] << (i * 8);
+    return value;
+}
+
+#endif
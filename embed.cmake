@@ -0,0 +1,31 @@
+# Converts a file into a C source file that defines it as a byte array.
+#
+# Usage: cmake -DINPUT=<file> -DOUTPUT=<source> -DNAME=<identifier> -P embed.cmake
+#
+# The source defines `const unsigned char <NAME>[]` with the file's contents
+# and `const size_t <NAME>_size` with its size, in bytes.
+
+file(READ ${INPUT} contents HEX)
+string(LENGTH "${contents}" length)
+math(EXPR size "${length} / 2")
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1, " bytes "${contents}")
+# CMake's regular expressions have no repetition counts, so spell out the
+# twelve bytes that go on each line
+string(REPEAT "0x[0-9a-f][0-9a-f], " 12 line)
+string(REGEX REPLACE "(${line})" "\\1\n    " bytes "${bytes}")
+string(REGEX REPLACE " +\n" "\n" bytes "${bytes}")
+string(REGEX REPLACE "[ \n]+$" "" bytes "${bytes}")
+get_filename_component(input_name ${INPUT} NAME)
+
+file(WRITE ${OUTPUT}
+"// Generated from ${input_name} by embed.cmake. Do not edit.
+
+#include <stddef.h>
+
+const unsigned char ${NAME}[${size}] =
+{
+    ${bytes}
+};
+
+const size_t ${NAME}_size = ${size};
+")
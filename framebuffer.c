@@ -0,0 +1,117 @@
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Implementation of the framebuffer module.
+///
+/// Rectangles are filled one row (span) at a time, several pixels per store
+/// using SSE2 or AVX2, whichever the compiler is targeting. A rectangle that
+/// covers whole rows is filled as one long span.
+
+#include "framebuffer.h"
+#include <stddef.h>
+#include <stdlib.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+/// The number of pixels written by one vector store.
+#define LANES 8
+
+typedef __m256i VecPixels;
+#define vec_set1 _mm256_set1_epi32
+#define vec_store(p, v) _mm256_storeu_si256((__m256i *)(p), (v))
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+/// The number of pixels written by one vector store.
+#define LANES 4
+
+typedef __m128i VecPixels;
+#define vec_set1 _mm_set1_epi32
+#define vec_store(p, v) _mm_storeu_si128((__m128i *)(p), (v))
+
+#endif
+
+/// Fills a run of consecutive pixels.
+/// \param[out] pixels  The first pixel.
+/// \param[in]  count   The number of pixels.
+/// \param[in]  color   The colour.
+static void fill_span(uint32_t *pixels, size_t count, uint32_t color)
+{
+    size_t i = 0;
+#ifdef LANES
+    VecPixels fill = vec_set1((int)color);
+    for (; i + LANES * 2 <= count; i += LANES * 2)
+    {
+        vec_store(pixels + i, fill);
+        vec_store(pixels + i + LANES, fill);
+    }
+    for (; i + LANES <= count; i += LANES)
+        vec_store(pixels + i, fill);
+#endif
+    for (; i < count; ++i)
+        pixels[i] = color;
+}
+
+bool fb_init(struct Framebuffer *fb, int width, int height)
+{
+    fb->width = width;
+    fb->height = height;
+    fb->pixels = calloc((size_t)width * (size_t)height, sizeof(uint32_t));
+    return fb->pixels != NULL;
+}
+
+void fb_free(struct Framebuffer *fb)
+{
+    free(fb->pixels);
+    fb->pixels = NULL;
+}
+
+void fb_fill_rect(struct Framebuffer *fb, int x, int y, int w, int h, uint32_t color)
+{
+    int left = x > 0 ? x : 0;
+    int top = y > 0 ? y : 0;
+    int right = x + w < fb->width ? x + w : fb->width;
+    int bottom = y + h < fb->height ? y + h : fb->height;
+    if (left >= right || top >= bottom)
+        return;
+
+    uint32_t *row = fb->pixels + (size_t)top * (size_t)fb->width + left;
+    size_t span = (size_t)(right - left);
+    if (span == (size_t)fb->width)
+    {
+        fill_span(row, span * (size_t)(bottom - top), color);
+        return;
+    }
+    for (int i = top; i < bottom; ++i)
+    {
+        fill_span(row, span, color);
+        row += fb->width;
+    }
+}
+
+void fb_draw_scene(struct Framebuffer *fb, const struct Scene *scene)
+{
+    for (size_t i = 0; i < scene->count; ++i)
+    {
+        const struct SceneRect *rect = &scene->rects[i];
+        fb_fill_rect(fb, rect->x, rect->y, rect->w, rect->h, rect->color);
+    }
+}
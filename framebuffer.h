@@ -0,0 +1,69 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Functionality exported by the framebuffer module.
+
+#include "scene.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/// A 32-bit image in memory. Rows are stored top to bottom with no padding
+/// between them, and each pixel is 0xAARRGGBB in native byte order, which
+/// is the layout of SDL_PIXELFORMAT_ARGB8888.
+struct Framebuffer
+{
+    /// The width, in pixels.
+    int width;
+
+    /// The height, in pixels.
+    int height;
+
+    /// The pixels.
+    uint32_t *pixels;
+};
+
+/// Allocates a framebuffer.
+/// \param[out] fb      The framebuffer to initialize.
+/// \param[in]  width   The width, in pixels.
+/// \param[in]  height  The height, in pixels.
+/// \returns    True if successful, false if memory could not be allocated.
+bool fb_init(struct Framebuffer *fb, int width, int height);
+
+/// Releases the memory used by a framebuffer.
+/// \param[in]  fb  The framebuffer.
+void fb_free(struct Framebuffer *fb);
+
+/// Fills a rectangle, clipped to the framebuffer's bounds.
+/// \param[in,out]  fb      The framebuffer.
+/// \param[in]      x       The X coordinate of the left edge.
+/// \param[in]      y       The Y coordinate of the top edge.
+/// \param[in]      w       The width.
+/// \param[in]      h       The height.
+/// \param[in]      color   The colour, as 0xAARRGGBB.
+void fb_fill_rect(struct Framebuffer *fb, int x, int y, int w, int h, uint32_t color);
+
+/// Fills every rectangle of a scene, in order.
+/// \param[in,out]  fb      The framebuffer.
+/// \param[in]      scene   The scene.
+void fb_draw_scene(struct Framebuffer *fb, const struct Scene *scene);
+
+#endif
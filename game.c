@@ -20,19 +20,23 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 /// \brief Implementation of the gameplay module.
 
 #include "game.h"
+#include "bytes.h"
 #include "coord.h"
-#include "sound.h"
+#include <limits.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
 
-const short player_x_coords[PLAYER_COUNT] = {8, TABLE_WIDTH - 8 - PADDLE_WIDTH};
+/// Returned by frames_until_in_range() when the value never enters the range.
+#define NEVER ULONG_MAX
 
-static void move_ball(struct GameState *state);
+const short player_x_coords[PLAYER_COUNT] = {8, TABLE_WIDTH - 8 - PADDLE_WIDTH};
 
-static void reset_ball(struct Ball *ball, int dir_x);
+static void move_ball(struct GameState *state, struct GameEvents *events);
 
-/// Computes the GCD of two numbers.
+/// Computes the GCD of two numbers. Paddle hits are the only caller, and
+/// there the numbers are bounded by the paddle and ball sizes, so the loop
+/// runs at most a handful of times.
 /// \param[in]  a   The first number.
 /// \param[in]  b   The second number.
 /// \returns    The GCD of the two numbers.
@@ -43,12 +47,34 @@ static int gcd(int a, int b)
     a = abs(a);
     b = abs(b);
 
-    if (a == b)
-        return a;
-    else if (a > b)
-        return gcd(a - b, b);
-    else
-        return gcd(a, b - a);
+    while (b != 0)
+    {
+        int remainder = a % b;
+        a = b;
+        b = remainder;
+    }
+    return a;
+}
+
+/// Recalculates the ball's velocity from its direction and speed. Division
+/// truncates towards zero, so negating a direction component negates the
+/// matching velocity component exactly, which lets bounces off the top and
+/// bottom edges skip this.
+/// \param[in]  ball    The ball.
+static void update_velocity(struct Ball *ball)
+{
+    int denom = abs(ball->dir_x) + abs(ball->dir_y);
+    ball->vel_x = coord_mul_frac(ball->speed, ball->dir_x, denom);
+    ball->vel_y = coord_mul_frac(ball->speed, ball->dir_y, denom);
+}
+
+/// Appends an event to an event buffer, if there is room for it.
+/// \param[out] events  The event buffer, or NULL.
+/// \param[in]  event   The event that occurred.
+static void push_event(struct GameEvents *events, enum GameEvent event)
+{
+    if (events && events->count < G_MAX_EVENTS)
+        events->events[events->count++] = event;
 }
 
 /// Increases a score, clamping if required.
@@ -76,9 +102,10 @@ static bool paddle_collide(int pad_x, int pad_y, int ball_x, int ball_y)
         && pad_y + PADDLE_HEIGHT > ball_y;
 }
 
-void g_init(struct GameState *state)
+void g_init(struct GameState *state, uint64_t seed)
 {
-    reset_ball(&(state->ball), -1);
+    rng_seed(&(state->rng), seed);
+    g_reset_ball(state, -1);
 
     for (size_t i = 0; i < PLAYER_COUNT; ++i)
     {
@@ -87,7 +114,10 @@ void g_init(struct GameState *state)
     }
 }
 
-void g_update(struct GameState *state, const PlayerInput *inputs)
+void g_update(
+    struct GameState *state,
+    const PlayerInput *inputs,
+    struct GameEvents *events)
 {
     for (size_t i = 0; i < PLAYER_COUNT; ++i)
     {
@@ -99,26 +129,23 @@ void g_update(struct GameState *state, const PlayerInput *inputs)
         state->players[i].y = new_y;
     }
 
-    move_ball(state);
+    move_ball(state, events);
 }
 
 /// Updates the ball's position and resolves collisions.
 /// \param[in]  state   The game state.
-static void move_ball(struct GameState *state)
+/// \param[out] events  Buffer that receives bounce and score events.
+static void move_ball(struct GameState *state, struct GameEvents *events)
 {
-    int speed = state->ball.speed;
-    int denom = abs(state->ball.dir_x) + abs(state->ball.dir_y);
-    int vel_x = coord_mul_frac(speed, state->ball.dir_x, denom);
-    int vel_y = coord_mul_frac(speed, state->ball.dir_y, denom);
-    int new_x = state->ball.x_coord + vel_x;
-    int new_y = state->ball.y_coord + vel_y;
+    int new_x = state->ball.x_coord + state->ball.vel_x;
+    int new_y = state->ball.y_coord + state->ball.vel_y;
 
     // Left edge collision
     if (new_x < 0)
     {
         state->players[1].score = inc_score(state->players[1].score);
-        reset_ball(&(state->ball), 1);
-        s_play_score();
+        g_reset_ball(state, 1);
+        push_event(events, G_EVENT_SCORE);
         return;
     }
 
@@ -126,8 +153,8 @@ static void move_ball(struct GameState *state)
     if (coord_to_int(new_x) + BALL_SIZE > TABLE_WIDTH)
     {
         state->players[0].score = inc_score(state->players[0].score);
-        reset_ball(&(state->ball), -1);
-        s_play_score();
+        g_reset_ball(state, -1);
+        push_event(events, G_EVENT_SCORE);
         return;
     }
 
@@ -135,16 +162,18 @@ static void move_ball(struct GameState *state)
     if (new_y < 0)
     {
         state->ball.dir_y = -state->ball.dir_y;
+        state->ball.vel_y = -state->ball.vel_y;
         new_y = 0;
-        s_play_bounce();
+        push_event(events, G_EVENT_BOUNCE);
     }
 
     // Bottom edge collision
     if (coord_to_int(new_y) + BALL_SIZE > TABLE_HEIGHT)
     {
         state->ball.dir_y = -state->ball.dir_y;
+        state->ball.vel_y = -state->ball.vel_y;
         new_y = coord_from_int(TABLE_HEIGHT - BALL_SIZE);
-        s_play_bounce();
+        push_event(events, G_EVENT_BOUNCE);
     }
 
     // Paddle collisions
@@ -171,7 +200,8 @@ static void move_ball(struct GameState *state)
             const int max_speed = coord_from_int(6);
             if (state->ball.speed > max_speed)
                 state->ball.speed = max_speed;
-            s_play_bounce();
+            update_velocity(&(state->ball));
+            push_event(events, G_EVENT_BOUNCE);
             break;
         }
     }
@@ -180,17 +210,253 @@ static void move_ball(struct GameState *state)
     state->ball.y_coord = new_y;
 }
 
-/// Returns the ball to its starting position.
-/// \param[out] ball    The ball.
-/// \param[in]  dir_x   The X direction the ball should travel.
-static void reset_ball(struct Ball *ball, int dir_x)
+/// Finds the first frame on which a value that changes by a constant amount
+/// each frame falls within a range.
+/// \param[in]  value       The value's current value.
+/// \param[in]  velocity    The amount the value changes by each frame.
+/// \param[in]  lo          The lowest value in the range.
+/// \param[in]  hi          The highest value in the range.
+/// \returns    The number of frames until the value is in the range (at least
+///             1), or NEVER.
+static unsigned long frames_until_in_range(int value, int velocity, int lo, int hi)
+{
+    long long next = (long long)value + velocity;
+    if (velocity == 0)
+        return value >= lo && value <= hi ? 1 : NEVER;
+    if (velocity > 0)
+    {
+        if (next > hi)
+            return NEVER;
+        if (next >= lo)
+            return 1;
+        long long frames = ((long long)lo - value + velocity - 1) / velocity;
+        return value + frames * velocity <= hi ? (unsigned long)frames : NEVER;
+    }
+    else
+    {
+        if (next < lo)
+            return NEVER;
+        if (next <= hi)
+            return 1;
+        long long frames = ((long long)value - hi - velocity - 1) / -velocity;
+        return value + frames * velocity >= lo ? (unsigned long)frames : NEVER;
+    }
+}
+
+/// Calculates a paddle's position after a number of frames with a constant
+/// input. Clamping once at the end is the same as clamping every frame.
+/// \param[in]  y       The paddle's current position.
+/// \param[in]  input   The player's input.
+/// \param[in]  frames  The number of frames.
+/// \returns    The paddle's position after \a frames frames.
+static int paddle_after(int y, PlayerInput input, unsigned long frames)
+{
+    long long new_y = y + (long long)input * frames;
+    if (new_y < 0)
+        new_y = 0;
+    else if (new_y > TABLE_HEIGHT - PADDLE_HEIGHT)
+        new_y = TABLE_HEIGHT - PADDLE_HEIGHT;
+    return (int)new_y;
+}
+
+/// Finds the first frame on which the ball might hit a paddle, assuming that
+/// nothing changes its velocity before then.
+/// \param[in]  state   The game state.
+/// \param[in]  inputs  The players' inputs.
+/// \param[in]  index   The paddle's player index.
+/// \returns    The number of frames until a possible collision (at least 1),
+///             or NEVER.
+static unsigned long frames_until_paddle(
+    const struct GameState *state,
+    const PlayerInput *inputs,
+    size_t index)
+{
+    const struct Ball *ball = &(state->ball);
+    const int lo = coord_from_int(player_x_coords[index] - BALL_SIZE + 1);
+    const int hi = coord_from_int(player_x_coords[index] + PADDLE_WIDTH) - 1;
+    unsigned long first = frames_until_in_range(ball->x_coord, ball->vel_x, lo, hi);
+    if (first == NEVER || ball->vel_x == 0)
+        return first;
+
+    // Find the last frame where the ball lines up with the paddle
+    // horizontally, then check whether the ball and paddle can line up
+    // vertically at any point in between
+    unsigned long last = ball->vel_x > 0
+        ? (unsigned long)((hi - ball->x_coord) / ball->vel_x)
+        : (unsigned long)((ball->x_coord - lo) / -ball->vel_x);
+    int ball_first = coord_to_int(ball->y_coord + (long long)ball->vel_y * first);
+    int ball_last = coord_to_int(ball->y_coord + (long long)ball->vel_y * last);
+    int pad_first = paddle_after(state->players[index].y, inputs[index], first);
+    int pad_last = paddle_after(state->players[index].y, inputs[index], last);
+    int ball_min = ball_first < ball_last ? ball_first : ball_last;
+    int ball_max = ball_first < ball_last ? ball_last : ball_first;
+    int pad_min = pad_first < pad_last ? pad_first : pad_last;
+    int pad_max = pad_first < pad_last ? pad_last : pad_first;
+    if (pad_min >= ball_max + BALL_SIZE || pad_max + PADDLE_HEIGHT <= ball_min)
+        return NEVER;
+    return first;
+}
+
+/// Finds the first frame on which the ball might hit an edge or a paddle,
+/// assuming that nothing changes its velocity before then.
+/// \param[in]  state   The game state.
+/// \param[in]  inputs  The players' inputs.
+/// \returns    The number of frames until a possible collision (at least 1),
+///             or NEVER.
+static unsigned long frames_until_collision(
+    const struct GameState *state,
+    const PlayerInput *inputs)
+{
+    const struct Ball *ball = &(state->ball);
+    const int right_edge = coord_from_int(TABLE_WIDTH - BALL_SIZE + 1);
+    const int bottom_edge = coord_from_int(TABLE_HEIGHT - BALL_SIZE + 1);
+    unsigned long frames[2 + 2 + PLAYER_COUNT] =
+    {
+        frames_until_in_range(ball->x_coord, ball->vel_x, INT_MIN, -1),
+        frames_until_in_range(ball->x_coord, ball->vel_x, right_edge, INT_MAX),
+        frames_until_in_range(ball->y_coord, ball->vel_y, INT_MIN, -1),
+        frames_until_in_range(ball->y_coord, ball->vel_y, bottom_edge, INT_MAX)
+    };
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+        frames[4 + i] = frames_until_paddle(state, inputs, i);
+
+    unsigned long first = NEVER;
+    for (size_t i = 0; i < sizeof(frames) / sizeof(frames[0]); ++i)
+    {
+        if (frames[i] < first)
+            first = frames[i];
+    }
+    return first;
+}
+
+/// Moves the ball and paddles by a number of frames in which nothing
+/// collides.
+/// \param[in]  state   The game state.
+/// \param[in]  inputs  The players' inputs.
+/// \param[in]  frames  The number of frames to skip.
+static void skip_frames(
+    struct GameState *state,
+    const PlayerInput *inputs,
+    unsigned long frames)
+{
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+        state->players[i].y = paddle_after(state->players[i].y, inputs[i], frames);
+
+    state->ball.x_coord += (long long)state->ball.vel_x * frames;
+    state->ball.y_coord += (long long)state->ball.vel_y * frames;
+}
+
+void g_advance(
+    struct GameState *state,
+    const PlayerInput *inputs,
+    unsigned long frames,
+    struct GameEvents *events)
+{
+    while (frames > 0)
+    {
+        unsigned long collision = frames_until_collision(state, inputs);
+        unsigned long skipped = collision > frames ? frames : collision - 1;
+        if (skipped > 0)
+        {
+            skip_frames(state, inputs, skipped);
+            frames -= skipped;
+        }
+        if (frames > 0)
+        {
+            g_update(state, inputs, events);
+            --frames;
+        }
+    }
+}
+
+void g_reset_ball(struct GameState *state, int dir_x)
 {
     const int min_x = 50;
     const int max_x = 160;
-    int rand_x = rand() / (RAND_MAX / (max_x - min_x) + 1) + min_x;
+    struct Ball *ball = &(state->ball);
+    int rand_x = (int)rng_range(&(state->rng), max_x - min_x) + min_x;
     ball->x_coord = coord_from_int(TABLE_WIDTH / 2 - BALL_SIZE / 2);
     ball->y_coord = coord_from_int(10);
     ball->dir_x = dir_x * rand_x;
     ball->dir_y = 64;
     ball->speed = coord_from_int(1);
+    update_velocity(ball);
+}
+
+void g_snapshot(const struct GameState *state, unsigned char *snapshot)
+{
+    const struct Ball *ball = &(state->ball);
+    snapshot[0] = G_SNAPSHOT_VERSION;
+    snapshot[1] = 0;
+    bytes_store_le(snapshot + 2, (uint16_t)ball->x_coord, 2);
+    bytes_store_le(snapshot + 4, (uint16_t)ball->y_coord, 2);
+    bytes_store_le(snapshot + 6, (uint16_t)ball->dir_x, 2);
+    bytes_store_le(snapshot + 8, (uint16_t)ball->dir_y, 2);
+    bytes_store_le(snapshot + 10, (uint16_t)ball->speed, 2);
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        snapshot[12 + i * 2] = state->players[i].score;
+        snapshot[13 + i * 2] = state->players[i].y;
+    }
+    bytes_store_le(snapshot + 12 + PLAYER_COUNT * 2, state->rng.state, 8);
+}
+
+bool g_restore(struct GameState *state, const unsigned char *snapshot)
+{
+    if (snapshot[0] != G_SNAPSHOT_VERSION || snapshot[1] != 0)
+        return false;
+
+    struct GameState restored;
+    struct Ball *ball = &(restored.ball);
+    ball->x_coord = (short)(int16_t)bytes_load_le(snapshot + 2, 2);
+    ball->y_coord = (short)(int16_t)bytes_load_le(snapshot + 4, 2);
+    ball->dir_x = (short)(int16_t)bytes_load_le(snapshot + 6, 2);
+    ball->dir_y = (short)(int16_t)bytes_load_le(snapshot + 8, 2);
+    ball->speed = (short)(int16_t)bytes_load_le(snapshot + 10, 2);
+    // A zero direction would divide by zero
+    if (ball->dir_x == 0 && ball->dir_y == 0)
+        return false;
+    update_velocity(ball);
+
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        restored.players[i].score = snapshot[12 + i * 2];
+        restored.players[i].y = snapshot[13 + i * 2];
+        if (restored.players[i].score > 99
+            || restored.players[i].y > TABLE_HEIGHT - PADDLE_HEIGHT)
+            return false;
+    }
+    restored.rng.state = bytes_load_le(snapshot + 12 + PLAYER_COUNT * 2, 8);
+
+    *state = restored;
+    return true;
+}
+
+void g_interpolate(
+    const struct GameState *previous,
+    const struct GameState *current,
+    int num,
+    int denom,
+    struct GameState *blended)
+{
+    *blended = *current;
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        if (previous->players[i].score != current->players[i].score)
+            return;
+    }
+
+    const struct Ball *from = &(previous->ball);
+    const struct Ball *to = &(current->ball);
+    blended->ball.x_coord = (short)(from->x_coord
+        + coord_mul_frac(to->x_coord - from->x_coord, num, denom));
+    blended->ball.y_coord = (short)(from->y_coord
+        + coord_mul_frac(to->y_coord - from->y_coord, num, denom));
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        int from_y = previous->players[i].y;
+        int to_y = current->players[i].y;
+        blended->players[i].y =
+            (unsigned char)(from_y + (to_y - from_y) * num / denom);
+    }
 }
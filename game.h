@@ -23,6 +23,10 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 /// \brief Functionality exported by the gameplay module.
 
 #include "constants.h"
+#include "rng.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /// Contains the current state of the ball.
 struct Ball
@@ -41,6 +45,14 @@ struct Ball
 
     /// The ball's speed.
     short speed;
+
+    /// The distance the ball moves horizontally each frame. Derived from the
+    /// direction and speed whenever either of them changes.
+    short vel_x;
+
+    /// The distance the ball moves vertically each frame. Derived from the
+    /// direction and speed whenever either of them changes.
+    short vel_y;
 };
 
 /// Represents how far a player wants to move their paddle.
@@ -64,16 +76,120 @@ struct GameState
 
     /// The players' information.
     struct PlayerState players[PLAYER_COUNT];
+
+    /// The random number generator used to serve the ball.
+    struct Rng rng;
+};
+
+/// Something that happened during an update that the player should be told
+/// about (e.g. by playing a sound effect).
+enum GameEvent
+{
+    /// The ball bounced off a wall or a paddle.
+    G_EVENT_BOUNCE,
+
+    /// A player scored a point.
+    G_EVENT_SCORE
 };
 
+/// The maximum number of events that a GameEvents buffer can hold.
+#define G_MAX_EVENTS 16
+
+/// A caller-owned buffer that collects events produced by g_update().
+struct GameEvents
+{
+    /// The number of events in the buffer.
+    size_t count;
+
+    /// The buffered events, in the order they happened.
+    enum GameEvent events[G_MAX_EVENTS];
+};
+
+/// The version of the layout written by g_snapshot().
+#define G_SNAPSHOT_VERSION 1
+
+/// The size of a snapshot, in bytes. Snapshot layouts only ever grow, so a
+/// buffer of this size holds a snapshot of any earlier version too.
+#define G_SNAPSHOT_SIZE 24
+
 /// Initializes the game state's members to their initial values.
 /// \param[out] state   The state to initialize.
-void g_init(struct GameState *state);
+/// \param[in]  seed    Seed for the game's random number generator. Games
+///                     with the same seed and inputs play out identically.
+void g_init(struct GameState *state, uint64_t seed);
 
 /// Updates the game's state by one frame, taking into account the players'
 /// inputs.
 /// \param[in]  state   The state to update.
 /// \param[in]  inputs  The players' inputs.
-void g_update(struct GameState *state, const PlayerInput *inputs);
+/// \param[out] events  Buffer that receives any events that occur during the
+///                     update, or NULL to discard them. Events are appended
+///                     after the existing ones and dropped once it is full.
+void g_update(
+    struct GameState *state,
+    const PlayerInput *inputs,
+    struct GameEvents *events);
+
+/// Returns the ball to its starting position and serves it in a random
+/// direction.
+/// \param[in]  state   The game state.
+/// \param[in]  dir_x   The X direction the ball should travel (1 or -1).
+void g_reset_ball(struct GameState *state, int dir_x);
+
+/// Updates the game's state by a number of frames, with the players' inputs
+/// held constant. The result is identical to calling g_update() \a frames
+/// times, but the frames in which the ball cannot hit anything are skipped
+/// over in a single step.
+/// \param[in]  state   The state to update.
+/// \param[in]  inputs  The players' inputs, used for every frame.
+/// \param[in]  frames  The number of frames to advance by.
+/// \param[out] events  Buffer that receives any events that occur, or NULL.
+void g_advance(
+    struct GameState *state,
+    const PlayerInput *inputs,
+    unsigned long frames,
+    struct GameEvents *events);
+
+/// Packs a game state, including its random number generator, into a
+/// fixed-size snapshot that is the same on every platform. The layout is:
+///
+/// | Offset | Size | Contents                                              |
+/// |--------|------|-------------------------------------------------------|
+/// | 0      | 1    | The layout version, #G_SNAPSHOT_VERSION               |
+/// | 1      | 1    | Reserved, zero                                        |
+/// | 2      | 10   | The ball's X and Y coordinates, X and Y direction and |
+/// |        |      | speed, as signed 16-bit numbers                       |
+/// | 12     | 4    | Each player's score, then paddle position, in bytes   |
+/// | 16     | 8    | The random number generator's state                   |
+///
+/// Numbers are little-endian. The ball's velocity is left out, as it is
+/// derived from its direction and speed.
+/// \param[in]  state       The state.
+/// \param[out] snapshot    Receives #G_SNAPSHOT_SIZE bytes.
+void g_snapshot(const struct GameState *state, unsigned char *snapshot);
+
+/// Unpacks a snapshot made by g_snapshot().
+/// \param[out] state       Receives the state. It is left unchanged if the
+///                         snapshot is invalid.
+/// \param[in]  snapshot    The #G_SNAPSHOT_SIZE bytes of the snapshot.
+/// \returns    True if successful, false if the snapshot has an unknown
+///             version or holds a state the game cannot reach.
+bool g_restore(struct GameState *state, const unsigned char *snapshot);
+
+/// Blends two consecutive states for display, moving the ball and paddles a
+/// fraction of the way from one state to the next. If a point was scored
+/// between the states, the ball has jumped back to the middle of the table,
+/// so \a current is used as-is.
+/// \param[in]  previous    The earlier state.
+/// \param[in]  current     The later state.
+/// \param[in]  num         The numerator of the fraction.
+/// \param[in]  denom       The denominator of the fraction.
+/// \param[out] blended     Receives the blended state.
+void g_interpolate(
+    const struct GameState *previous,
+    const struct GameState *current,
+    int num,
+    int denom,
+    struct GameState *blended);
 
 #endif
@@ -20,74 +20,199 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 /// \brief Program entry point.
 
 #include "ai.h"
+#include "constants.h"
+#include "framebuffer.h"
 #include "game.h"
+#include "netplay.h"
+#include "pacer.h"
 #include "renderer.h"
+#include "replay.h"
+#include "rollback.h"
 #include "sound.h"
+#include "stats.h"
 #include "util.h"
+#include "video.h"
 #include <SDL.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
-/// The length of one frame (in milliseconds).
-#define FRAME_TIME (1000/60)
+/// The number of times per second the simulation is updated.
+#define TICK_RATE 60
+
+/// The most simulation steps run in one frame. After a stall, any time left
+/// over is dropped rather than fast-forwarding the game.
+#define MAX_STEPS_PER_FRAME 5
+
+/// The resolution of the fraction used to interpolate between states.
+#define BLEND_SCALE 256
+
+/// The highest accepted frame rate limit.
+#define MAX_FPS 1000
+
+/// The highest accepted winning score, which is the most the score display
+/// can show.
+#define MAX_TARGET 99
+
+/// The number of ticks between keyframes in a replay.
+#define KEYFRAME_INTERVAL (TICK_RATE * 10)
+
+/// The number of ticks a recorded match may run for per point in the target
+/// score, in case neither player can score.
+#define MAX_TICKS_PER_POINT (TICK_RATE * 60 * 10)
 
 /// The help text displayed when the `--help` option is provided.
 static const char * const help_text =
 "Options:\n"
 "--vsync\t\tEnables vertical synchronization\n"
+"--fps=<rate>\tLimits the frame rate; 0 disables the limit\n"
+"\t\t(default 60, or 0 with --vsync)\n"
+"--renderer=<backend>\tSets how frames are drawn: sdl (default) or software\n"
 "--player1=<difficulty>\tSets the AI difficulty for player 1\n"
 "--player2=<difficulty>\tSets the AI difficulty for player 2\n"
+"--seed=<number>\tSets the random seed, so that a game can be reproduced\n"
+"--stats\t\tShows frame timing statistics and saves them on exit\n"
+"--stats-file=<path>\tSets the file the statistics are saved to\n"
+"\t\t(default frame_stats.csv)\n"
+"--record-video=<path>\tPlays one match without a window or sound and\n"
+"\t\twrites every tick to <path>, or to standard output if <path> is -\n"
+"--video-format=<format>\tSets the video format: y4m (default) or rgba\n"
+"--target=<score>\tSets the score that ends a recorded match (default 11)\n"
+"--record=<path>\tSaves the seed and every input to a replay file on exit\n"
+"--replay=<path>\tPlays a replay file without a window or sound as fast as\n"
+"\t\tpossible, and checks that it ends in the recorded state\n"
+"--seek=<tick>\tStarts a replay at the given tick\n"
+"--netplay=<host>:<port>\tPlays against another copy of the game over UDP;\n"
+"\t\tboth must use the same --seed\n"
+"--local-port=<port>\tSets the UDP port to listen on (default 7000)\n"
+"--net-player=<1|2>\tSets the player controlled on this machine (default 1)\n"
+"--input-delay=<ticks>\tSets how many ticks local inputs are delayed by in\n"
+"\t\tnetplay, up to 15 (default 2)\n"
+"--net-latency=<ms>\tHolds back every packet sent, to test netplay\n"
+"--net-jitter=<ms>\tHolds back every packet sent by up to this much more\n"
+"--audio-buffer=<frames>\tSets the audio buffer size: a power of two from\n"
+"\t\t64 to 4096 (default 1024), or low for 256. Smaller buffers play\n"
+"\t\tsounds sooner, and grow by themselves if the audio runs dry\n"
+"--startup-trace\tLogs how long each stage of startup takes, up to the\n"
+"\t\tfirst frame\n"
 "\n<difficulty> is one of:\n"
 "\tnone\tThe player is not AI-controlled\n"
 "\teasy\n"
 "\tnormal\n"
-"\thard\n";
+"\thard\n"
+"\texpert\tPredicts where the ball will go\n";
 
 /// Contains user-supplied options.
 struct GameOptions
 {
     /// Whether V-sync should be used.
     bool use_vsync;
+
+    /// The frame rate limit, zero for no limit, or -1 for the default.
+    int fps;
+
+    /// How frames are drawn.
+    enum RendererBackend backend;
+
+    /// The seed for the game's random number generator.
+    uint64_t seed;
+
+    /// The difficulties of the game's players.
+    enum AIDifficulty difficulties[PLAYER_COUNT];
+
+    /// Whether frame timing statistics should be collected and shown.
+    bool show_stats;
+
+    /// The file frame timing statistics are saved to.
+    const char *stats_file;
+
+    /// The file a match is recorded to, "-" for standard output, or NULL to
+    /// play normally.
+    const char *video_path;
+
+    /// The format a match is recorded in.
+    enum VideoFormat video_format;
+
+    /// The score that ends a recorded match.
+    unsigned target;
+
+    /// The replay file the game is recorded to, or NULL.
+    const char *record_path;
+
+    /// The replay file to play instead of a game, or NULL.
+    const char *replay_path;
+
+    /// The tick a replay starts at.
+    uint64_t seek;
+
+    /// The netplay settings. Netplay is off if no peer is given.
+    struct NetplayOptions netplay;
+
+    /// The audio buffer size, in sample frames.
+    int audio_buffer;
+
+    /// Whether the time taken by each stage of startup should be logged.
+    bool startup_trace;
+};
+
+/// The time taken by the stages of startup, logged with `--startup-trace`.
+struct StartupTrace
+{
+    /// Whether the stages are logged.
+    bool enabled;
+
+    /// The performance counter value when the program started.
+    Uint64 start;
+
+    /// The performance counter value when the current stage started.
+    Uint64 stage_start;
 };
 
 /// The controllers (if any) used by the players.
 static SDL_GameController *controllers[PLAYER_COUNT];
 
-/// Determines if a string begins with a prefix.
-/// \param[in]  str     The string to search.
-/// \param[in]  prefix  The string to search for.
-/// \returns    Whether the string begins with the prefix.
-static bool starts_with(const char *str, const char *prefix)
+/// The frame timing statistics.
+static struct FrameStats frame_stats;
+
+/// The startup timing.
+static struct StartupTrace startup_trace;
+
+/// Gets the renderer backend after the equals sign in the given string.
+/// \param[in]  arg The argument text.
+/// \returns    The parsed backend.
+static enum RendererBackend extract_backend(const char *arg)
 {
-    size_t prefix_len = strlen(prefix);
-    return strncmp(str, prefix, prefix_len) == 0;
+    const char *value = strchr(arg, '=') + 1;
+    if (strcmp(value, "sdl") == 0)
+        return R_BACKEND_SDL;
+    if (strcmp(value, "software") == 0)
+        return R_BACKEND_SOFTWARE;
+
+    fprintf(stderr, "Unrecognized renderer '%s'\n", value);
+    exit(EXIT_FAILURE);
 }
 
-/// Gets the difficulty after the equals sign in the given string.
+/// Gets the audio buffer size after the equals sign in the given string.
 /// \param[in]  arg The argument text.
-/// \returns    The parsed difficulty.
-static enum AIDifficulty extract_difficulty(const char *arg)
+/// \returns    The parsed size, in sample frames.
+static int extract_audio_buffer(const char *arg)
 {
-    const char *equals = strchr(arg, '=');
-    const char *diff = equals + 1;
-    if (strcmp(diff, "none") == 0)
-        return AI_NONE;
-    else if (strcmp(diff, "easy") == 0)
-        return AI_EASY;
-    else if (strcmp(diff, "normal") == 0)
-        return AI_NORMAL;
-    else if (strcmp(diff, "hard") == 0)
-        return AI_HARD;
-    else
+    const char *value = strchr(arg, '=') + 1;
+    if (strcmp(value, "low") == 0)
+        return S_LOW_LATENCY_BUFFER;
+
+    unsigned long size = u_extract_number(
+        arg, S_MIN_BUFFER, S_MAX_BUFFER, "audio buffer size");
+    if ((size & (size - 1)) != 0)
     {
-        fprintf(stderr, "Unrecognized difficulty '%s'\n", diff);
+        fprintf(stderr, "Invalid audio buffer size '%s'\n", value);
         exit(EXIT_FAILURE);
     }
-    
+    return (int)size;
 }
 
 /// Parses the program's command line arguments.
@@ -96,21 +221,127 @@ static enum AIDifficulty extract_difficulty(const char *arg)
 /// \returns Parsed options.
 static struct GameOptions parse_args(int argc, char **argv)
 {
-    struct GameOptions options = { false };
+    struct GameOptions options =
+    {
+        false,
+        -1,
+        R_BACKEND_SDL,
+        (uint64_t)time(NULL),
+        { AI_NONE },
+        false,
+        "frame_stats.csv",
+        NULL,
+        VID_FORMAT_Y4M,
+        11,
+        NULL,
+        NULL,
+        0,
+        { NULL, 7000, 0, 2, 0, 0 },
+        S_DEFAULT_BUFFER,
+        false
+    };
     for (int i = 1; i < argc; ++i)
     {
-        if (starts_with(argv[i], "--player1="))
+        if (u_starts_with(argv[i], "--player1="))
         {
-            ai_difficulties[0] = extract_difficulty(argv[i]);
+            options.difficulties[0] = u_extract_difficulty(argv[i], true);
         }
-        else if (starts_with(argv[i], "--player2="))
+        else if (u_starts_with(argv[i], "--player2="))
         {
-            ai_difficulties[1] = extract_difficulty(argv[i]);
+            options.difficulties[1] = u_extract_difficulty(argv[i], true);
+        }
+        else if (u_starts_with(argv[i], "--seed="))
+        {
+            options.seed = u_extract_u64(argv[i], "seed");
         }
         else if (strcmp(argv[i], "--vsync") == 0)
         {
             options.use_vsync = true;
         }
+        else if (u_starts_with(argv[i], "--fps="))
+        {
+            options.fps = (int)u_extract_number(
+                argv[i], 0, MAX_FPS, "frame rate");
+        }
+        else if (u_starts_with(argv[i], "--renderer="))
+        {
+            options.backend = extract_backend(argv[i]);
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            options.show_stats = true;
+        }
+        else if (u_starts_with(argv[i], "--stats-file="))
+        {
+            options.stats_file = argv[i] + strlen("--stats-file=");
+        }
+        else if (u_starts_with(argv[i], "--record-video="))
+        {
+            options.video_path = argv[i] + strlen("--record-video=");
+        }
+        else if (u_starts_with(argv[i], "--video-format="))
+        {
+            const char *name = argv[i] + strlen("--video-format=");
+            if (!vid_parse_format(name, &options.video_format))
+            {
+                fprintf(stderr, "Unrecognized video format '%s'\n", name);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (u_starts_with(argv[i], "--target="))
+        {
+            options.target = (unsigned)u_extract_number(
+                argv[i], 1, MAX_TARGET, "target score");
+        }
+        else if (u_starts_with(argv[i], "--record="))
+        {
+            options.record_path = argv[i] + strlen("--record=");
+        }
+        else if (u_starts_with(argv[i], "--replay="))
+        {
+            options.replay_path = argv[i] + strlen("--replay=");
+        }
+        else if (u_starts_with(argv[i], "--seek="))
+        {
+            options.seek = u_extract_u64(argv[i], "seek tick");
+        }
+        else if (u_starts_with(argv[i], "--netplay="))
+        {
+            options.netplay.peer = argv[i] + strlen("--netplay=");
+        }
+        else if (u_starts_with(argv[i], "--local-port="))
+        {
+            options.netplay.local_port = (unsigned short)u_extract_number(
+                argv[i], 1, 65535, "port");
+        }
+        else if (u_starts_with(argv[i], "--net-player="))
+        {
+            options.netplay.local_player = u_extract_number(
+                argv[i], 1, PLAYER_COUNT, "player") - 1u;
+        }
+        else if (u_starts_with(argv[i], "--input-delay="))
+        {
+            options.netplay.input_delay = (unsigned)u_extract_number(
+                argv[i], 0, RB_MAX_INPUT_DELAY, "input delay");
+        }
+        else if (u_starts_with(argv[i], "--net-latency="))
+        {
+            options.netplay.latency = (unsigned)u_extract_number(
+                argv[i], 0, NP_MAX_LATENCY, "latency");
+        }
+        else if (u_starts_with(argv[i], "--net-jitter="))
+        {
+            options.netplay.jitter = (unsigned)u_extract_number(
+                argv[i], 0, NP_MAX_LATENCY, "jitter");
+        }
+        else if (u_starts_with(argv[i], "--audio-buffer="))
+        {
+            options.audio_buffer = extract_audio_buffer(argv[i]);
+        }
+        else if (strcmp(argv[i], "--startup-trace") == 0)
+        {
+            options.startup_trace = true;
+        }
         else if (strcmp(argv[i], "--help") == 0)
         {
             puts(help_text);
@@ -122,6 +353,13 @@ static struct GameOptions parse_args(int argc, char **argv)
             exit(EXIT_FAILURE);
         }
     }
+    if (options.fps < 0)
+        options.fps = options.use_vsync ? 0 : TICK_RATE;
+    if (options.netplay.peer && options.record_path)
+    {
+        fprintf(stderr, "%s: --record cannot be used with --netplay\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
     return options;
 }
 
@@ -224,53 +462,414 @@ static void read_inputs(PlayerInput *inputs)
     }
 }
 
+/// Plays the sound effects for the events produced by the simulation, then
+/// empties the event buffer.
+/// \param[in,out]  events  The events to play.
+static void play_events(struct GameEvents *events)
+{
+    for (size_t i = 0; i < events->count; ++i)
+    {
+        switch (events->events[i])
+        {
+            case G_EVENT_BOUNCE:
+                s_play_bounce();
+                break;
+            case G_EVENT_SCORE:
+                s_play_score();
+                break;
+        }
+    }
+    events->count = 0;
+}
+
+/// Records the time taken by a stage of the frame, if statistics are being
+/// collected, and starts timing the next stage.
+/// \param[in,out]  stats   The statistics, or NULL if they are not collected.
+/// \param[in]      stage   The stage that has finished.
+/// \param[in,out]  start   The performance counter value when the stage
+///                         started; receives the current value.
+static void end_stage(struct FrameStats *stats, enum FrameStage stage, Uint64 *start)
+{
+    if (!stats)
+        return;
+
+    Uint64 now = SDL_GetPerformanceCounter();
+    double ns = (double)(now - *start) * 1e9 / SDL_GetPerformanceFrequency();
+    st_record(stats, stage, (uint64_t)ns);
+    *start = now;
+}
+
+/// Logs the time taken by a stage of startup, if startup is being traced,
+/// and starts timing the next stage.
+/// \param[in]  stage   The stage that has finished.
+static void trace_startup(const char *stage)
+{
+    if (!startup_trace.enabled)
+        return;
+
+    Uint64 now = SDL_GetPerformanceCounter();
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    SDL_Log(
+        "Startup: %-20s %8.2f ms, %8.2f ms in total",
+        stage,
+        (double)(now - startup_trace.stage_start) * 1000.0 / frequency,
+        (double)(now - startup_trace.start) * 1000.0 / frequency);
+    startup_trace.stage_start = now;
+}
+
+/// Logs a summary of the frame timing statistics and saves them to a file.
+/// \param[in]  stats   The statistics.
+/// \param[in]  path    The file to save them to.
+static void save_stats(const struct FrameStats *stats, const char *path)
+{
+    for (size_t i = 0; i < ST_STAGE_COUNT; ++i)
+    {
+        const struct Histogram *histogram = &stats->stages[i];
+        SDL_Log(
+            "%-8s p50 %8.1f us, p99 %8.1f us, max %8.1f us",
+            st_stage_name((enum FrameStage)i),
+            st_percentile(histogram, 50.0) / 1000.0,
+            st_percentile(histogram, 99.0) / 1000.0,
+            histogram->max / 1000.0);
+    }
+
+    if (st_write_csv(stats, path))
+        SDL_Log("Saved frame statistics to '%s'", path);
+    else
+        SDL_Log("Could not save frame statistics to '%s'", path);
+}
+
+/// Gets the input of the player controlled on this machine in netplay. They
+/// can use either player's keys or controller, or be AI-controlled.
+/// \param[in]  options The user-supplied options.
+/// \param[in]  inputs  The inputs read for each player.
+/// \returns    The local player's input.
+static PlayerInput local_input(const struct GameOptions *options, const PlayerInput *inputs)
+{
+    size_t player = options->netplay.local_player;
+    if (inputs[player] != 0 || options->difficulties[player] != AI_NONE)
+        return inputs[player];
+    return inputs[1 - player];
+}
+
 /// The game loop.
+/// \param[in]  options The user-supplied options.
+/// \param[in]  netplay The netplay session, or NULL to play locally.
 /// \returns True if the loop finished without errors, false otherwise.
-static bool main_loop(void)
+static bool main_loop(const struct GameOptions *options, struct Netplay *netplay)
 {
     struct GameState game_state;
+    struct GameEvents events = { 0 };
+    struct AIPlayer ai_players[PLAYER_COUNT];
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        if (options->difficulties[i] != AI_NONE)
+            ai_init(&ai_players[i], options->difficulties[i]);
+    }
     
-    g_init(&game_state);
-    Uint32 last_frame = SDL_GetTicks();
-    int remaining_time = 0;
-    while (1)
+    struct ReplayWriter recorder;
+    bool recording = options->record_path != NULL;
+    if (recording
+        && !rp_create(
+            &recorder,
+            options->record_path,
+            options->seed,
+            options->difficulties,
+            KEYFRAME_INTERVAL))
     {
+        SDL_LogError(
+            SDL_LOG_CATEGORY_APPLICATION,
+            "Failed to create replay '%s'",
+            options->record_path);
+        return false;
+    }
+
+    struct FrameStats *stats = options->show_stats ? &frame_stats : NULL;
+    if (netplay)
+        game_state = *np_state(netplay);
+    else
+        g_init(&game_state, options->seed);
+    struct GameState previous_state = game_state;
+
+    // Time is accumulated in units of 1/TICK_RATE performance counter ticks,
+    // so a step costs exactly one second's worth of counter ticks and the
+    // tick rate is exact
+    const Uint64 step_cost = SDL_GetPerformanceFrequency();
+    Uint64 last_frame = SDL_GetPerformanceCounter();
+    Uint64 accumulator = 0;
+    struct Pacer pacer;
+    pacer_init(&pacer, (unsigned)options->fps);
+    bool first_frame = true;
+    bool successful = true;
+    for (;;)
+    {
+        Uint64 frame_start = SDL_GetPerformanceCounter();
+        Uint64 stage_start = frame_start;
         SDL_Event e;
         while (SDL_PollEvent(&e))
         {
+            r_handle_event(&e);
             switch (e.type)
             {
                 case SDL_CONTROLLERDEVICEADDED:
                     if (!add_controller(e.cdevice.which))
-                        return false;
+                    {
+                        successful = false;
+                        goto finish;
+                    }
                     break;
                 case SDL_CONTROLLERDEVICEREMOVED:
                     remove_controller(e.cdevice.which);
                     break;
                 case SDL_QUIT:
-                    return true;
+                    goto finish;
             }
         }
 
-        Uint32 current_frame = SDL_GetTicks();
-        int elapsed = current_frame - last_frame;
-        remaining_time += elapsed;
+        end_stage(stats, ST_STAGE_EVENTS, &stage_start);
+
+        Uint64 current_frame = SDL_GetPerformanceCounter();
+        accumulator += (current_frame - last_frame) * TICK_RATE;
         last_frame = current_frame;
         PlayerInput inputs[PLAYER_COUNT] = {0};
         read_inputs(inputs);
-        if (ai_difficulties[0] != AI_NONE)
-            inputs[0] = ai_determine_input(&game_state, 0);
-        if (ai_difficulties[1] != AI_NONE)
-            inputs[1] = ai_determine_input(&game_state, 1);
-        while (remaining_time >= FRAME_TIME)
+        end_stage(stats, ST_STAGE_INPUT, &stage_start);
+
+        for (size_t i = 0; i < PLAYER_COUNT; ++i)
+        {
+            // In netplay, the other player's AI runs on the other machine
+            if (netplay && i != options->netplay.local_player)
+                continue;
+            if (options->difficulties[i] != AI_NONE)
+                inputs[i] = ai_determine_input(&ai_players[i], &game_state, i);
+        }
+        end_stage(stats, ST_STAGE_AI, &stage_start);
+
+        if (netplay)
+            np_poll(netplay);
+        int steps = 0;
+        while (accumulator >= step_cost && steps < MAX_STEPS_PER_FRAME)
+        {
+            previous_state = game_state;
+            if (netplay)
+            {
+                if (np_advance(netplay, local_input(options, inputs), &events))
+                    game_state = *np_state(netplay);
+            }
+            else
+            {
+                if (recording && !rp_record(&recorder, &game_state, inputs))
+                {
+                    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Out of memory");
+                    successful = false;
+                    goto finish;
+                }
+                g_update(&game_state, inputs, &events);
+            }
+            accumulator -= step_cost;
+            ++steps;
+        }
+        if (accumulator >= step_cost)
+            accumulator %= step_cost;
+        play_events(&events);
+        s_update();
+        end_stage(stats, ST_STAGE_UPDATE, &stage_start);
+
+        struct GameState display_state;
+        g_interpolate(
+            &previous_state,
+            &game_state,
+            (int)(accumulator * BLEND_SCALE / step_cost),
+            BLEND_SCALE,
+            &display_state);
+        if (!r_draw_frame(&display_state)
+            || (stats && !r_draw_stats(stats)))
+        {
+            successful = false;
+            goto finish;
+        }
+        end_stage(stats, ST_STAGE_DRAW, &stage_start);
+
+        if (!r_present())
+        {
+            successful = false;
+            goto finish;
+        }
+        end_stage(stats, ST_STAGE_PRESENT, &stage_start);
+        if (first_frame)
+        {
+            trace_startup("first frame");
+            first_frame = false;
+        }
+
+        pacer_wait(&pacer);
+        end_stage(stats, ST_STAGE_WAIT, &stage_start);
+        end_stage(stats, ST_STAGE_FRAME, &frame_start);
+    }
+
+finish:
+    // Report the timing and save whatever was recorded, however the game
+    // ended
+    pacer_report(&pacer);
+    if (recording && !rp_finish(&recorder, &game_state))
+    {
+        SDL_LogError(
+            SDL_LOG_CATEGORY_APPLICATION,
+            "Failed to save replay '%s'",
+            options->record_path);
+        successful = false;
+    }
+    return successful;
+}
+
+/// Plays one match as fast as possible without a window or sound, drawing
+/// every tick in software and writing it to a video.
+/// \param[in]  options The user-supplied options.
+/// \returns True if the whole match was recorded, false otherwise.
+static bool record_video(const struct GameOptions *options)
+{
+    struct VideoWriter *writer = vid_open(
+        options->video_path,
+        options->video_format,
+        DISPLAY_WIDTH,
+        DISPLAY_HEIGHT,
+        TICK_RATE);
+    if (!writer)
+        return false;
+
+    struct GameState state;
+    g_init(&state, options->seed);
+    struct AIPlayer ai_players[PLAYER_COUNT];
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        if (options->difficulties[i] != AI_NONE)
+            ai_init(&ai_players[i], options->difficulties[i]);
+    }
+
+    const unsigned long max_ticks = MAX_TICKS_PER_POINT * options->target;
+    Uint64 start = SDL_GetPerformanceCounter();
+    unsigned long frames = 0;
+    bool successful = true;
+    struct Scene scene;
+    for (;;)
+    {
+        struct Framebuffer framebuffer =
+        {
+            DISPLAY_WIDTH, DISPLAY_HEIGHT, vid_begin_frame(writer)
+        };
+        if (!framebuffer.pixels)
+        {
+            successful = false;
+            break;
+        }
+        sc_clear(&scene);
+        sc_add_frame(&scene, &state);
+        fb_draw_scene(&framebuffer, &scene);
+        vid_end_frame(writer);
+        ++frames;
+
+        bool finished = frames > max_ticks;
+        for (size_t i = 0; i < PLAYER_COUNT; ++i)
+        {
+            if (state.players[i].score >= options->target)
+                finished = true;
+        }
+        if (finished)
+            break;
+
+        PlayerInput inputs[PLAYER_COUNT] = {0};
+        for (size_t i = 0; i < PLAYER_COUNT; ++i)
         {
-            g_update(&game_state, inputs);
-            remaining_time -= FRAME_TIME;
+            if (options->difficulties[i] != AI_NONE)
+                inputs[i] = ai_determine_input(&ai_players[i], &state, i);
         }
+        g_update(&state, inputs, NULL);
+    }
+
+    if (!vid_close(writer))
+        successful = false;
+    double seconds = (double)(SDL_GetPerformanceCounter() - start)
+        / SDL_GetPerformanceFrequency();
+    SDL_Log(
+        "Recorded %lu frames (%u-%u) in %.2f s, %.0f frames/s",
+        frames,
+        (unsigned)state.players[0].score,
+        (unsigned)state.players[1].score,
+        seconds,
+        seconds > 0.0 ? frames / seconds : 0.0);
+    return successful;
+}
 
-        if (!r_draw_frame(&game_state))
+/// Plays a replay file as fast as possible without a window or sound, and
+/// checks that it ends in the recorded state.
+/// \param[in]  path    The replay file.
+/// \param[in]  seek    The tick to start at.
+/// \returns True if the replay was reproduced exactly, false otherwise.
+static bool play_replay(const char *path, uint64_t seek)
+{
+    struct ReplayReader reader;
+    if (!rp_open(&reader, path))
+    {
+        SDL_LogError(
+            SDL_LOG_CATEGORY_APPLICATION,
+            "Failed to read replay '%s'",
+            path);
+        return false;
+    }
+
+    struct GameState state;
+    g_init(&state, reader.seed);
+    Uint64 start = SDL_GetPerformanceCounter();
+    if (seek > 0)
+    {
+        if (!rp_seek(&reader, seek, &state))
+        {
+            SDL_LogError(
+                SDL_LOG_CATEGORY_APPLICATION,
+                "The replay ends before tick %llu",
+                (unsigned long long)seek);
+            rp_close(&reader);
             return false;
+        }
+        SDL_Log(
+            "Seeked to tick %llu in %.3f ms",
+            (unsigned long long)seek,
+            (double)(SDL_GetPerformanceCounter() - start) * 1000.0
+                / SDL_GetPerformanceFrequency());
     }
+    PlayerInput inputs[PLAYER_COUNT];
+    while (rp_next(&reader, inputs))
+        g_update(&state, inputs, NULL);
+    double seconds = (double)(SDL_GetPerformanceCounter() - start)
+        / SDL_GetPerformanceFrequency();
+
+    SDL_Log(
+        "Replayed %llu ticks (%s vs %s, seed %llu) in %.3f s",
+        (unsigned long long)reader.ticks,
+        ai_difficulty_name(reader.difficulties[0]),
+        ai_difficulty_name(reader.difficulties[1]),
+        (unsigned long long)reader.seed,
+        seconds);
+    SDL_Log(
+        "Final score: %u-%u",
+        (unsigned)state.players[0].score,
+        (unsigned)state.players[1].score);
+    bool successful = reader.complete
+        && reader.final_hash == rp_state_hash(&state);
+    if (!reader.complete)
+    {
+        SDL_LogError(
+            SDL_LOG_CATEGORY_APPLICATION,
+            "The replay is truncated or corrupt");
+    }
+    else if (!successful)
+    {
+        SDL_LogError(
+            SDL_LOG_CATEGORY_APPLICATION,
+            "The final state does not match the recording");
+    }
+    rp_close(&reader);
+    return successful;
 }
 
 /// Program entry point.
@@ -279,26 +878,57 @@ static bool main_loop(void)
 /// \returns    The exit status.
 int main(int argc, char **argv)
 {
+    startup_trace.start = SDL_GetPerformanceCounter();
+    startup_trace.stage_start = startup_trace.start;
     struct GameOptions options = parse_args(argc, argv);
-    srand(time(NULL));
+    startup_trace.enabled = options.startup_trace;
+    if (options.replay_path)
+        return play_replay(options.replay_path, options.seek) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (options.video_path)
+    {
+        SDL_Log("Random seed: %llu", (unsigned long long)options.seed);
+        return record_video(&options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    if (SDL_Init(SDL_INIT_VIDEO|SDL_INIT_AUDIO|SDL_INIT_GAMECONTROLLER) != 0)
+    // Audio is initialized by the sound module
+    if (SDL_Init(SDL_INIT_VIDEO|SDL_INIT_GAMECONTROLLER) != 0)
     {
         u_display_sdl_error();
         return EXIT_FAILURE;
     }
     atexit(SDL_Quit);
+    trace_startup("SDL_Init");
 
-    if (!s_init())
+    // The audio device opens in the background while the window is created
+    if (!s_init(options.audio_buffer, options.startup_trace))
         return EXIT_FAILURE;
     atexit(s_quit);
-    if (!r_init(options.use_vsync))
+    trace_startup("audio and sound thread");
+    if (!r_init(options.use_vsync, options.backend))
         return EXIT_FAILURE;
     atexit(r_quit);
+    trace_startup("window and renderer");
 
     atexit(close_controllers);
 
-    bool successful_exit = main_loop();
+    SDL_Log("Random seed: %llu", (unsigned long long)options.seed);
+    struct Netplay *netplay = NULL;
+    if (options.netplay.peer)
+    {
+        netplay = np_open(&options.netplay, options.seed);
+        if (!netplay)
+            return EXIT_FAILURE;
+        trace_startup("netplay socket");
+    }
+    bool successful_exit = main_loop(&options, netplay);
+    s_report();
+    if (options.show_stats)
+        save_stats(&frame_stats, options.stats_file);
+    if (netplay)
+    {
+        np_report(netplay);
+        np_close(netplay);
+    }
 
     return successful_exit ? EXIT_SUCCESS : EXIT_FAILURE;
 }
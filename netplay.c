@@ -0,0 +1,657 @@
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Implementation of the netplay module.
+///
+/// A packet is laid out as follows, with numbers in little-endian order:
+///
+/// | Offset | Size | Contents                                              |
+/// |--------|------|-------------------------------------------------------|
+/// | 0      | 4    | Magic number "TTNP"                                   |
+/// | 4      | 1    | Protocol version                                      |
+/// | 5      | 1    | The sender's player index                             |
+/// | 6      | 1    | The sender's input delay, in ticks                    |
+/// | 7      | 1    | The number of inputs, n                               |
+/// | 8      | 4    | The low 32 bits of the game's seed                    |
+/// | 12     | 4    | The sender's next tick                                |
+/// | 16     | 4    | The number of the receiver's inputs the sender has    |
+/// | 20     | 4    | The sender's clock, in milliseconds                   |
+/// | 24     | 4    | The last clock value the sender received, or zero     |
+/// | 28     | 2    | How long ago the sender received it, in milliseconds  |
+/// | 30     | 1    | How many ticks the sender is ahead, as a signed byte  |
+/// | 31     | 1    | Reserved, zero                                        |
+/// | 32     | 4    | The tick of the first input                           |
+/// | 36     | n    | The sender's inputs, one signed byte each             |
+///
+/// Each peer only knows how far ahead it is of the other peer's tick as of
+/// half a round trip ago, which overstates its lead by the same amount on
+/// both sides, so the difference between the two leads is twice the real
+/// lead. The peer that is ahead skips a tick now and then until they agree.
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+// Needed for getaddrinfo() in strict C99 mode
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include "netplay.h"
+#include "bytes.h"
+#include "rng.h"
+#include "rollback.h"
+#include "stats.h"
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+typedef SOCKET NetSocket;
+#define INVALID_NET_SOCKET INVALID_SOCKET
+#define close_socket closesocket
+#else
+typedef int NetSocket;
+#define INVALID_NET_SOCKET (-1)
+#define close_socket close
+#endif
+
+/// The version of the protocol.
+#define PROTOCOL_VERSION 1
+
+/// The size of a packet's header, in bytes.
+#define HEADER_SIZE 36
+
+/// The most inputs sent in one packet.
+#define MAX_PACKET_INPUTS (RB_MAX_PREDICTION + RB_MAX_INPUT_DELAY + 1)
+
+/// The largest packet, in bytes.
+#define MAX_PACKET_SIZE (HEADER_SIZE + MAX_PACKET_INPUTS)
+
+/// The most packets that can be held back at once. At 60 packets a second,
+/// this covers the highest latency plus the highest jitter.
+#define MAX_HELD_PACKETS 128
+
+/// How far one peer's lead has to exceed the other's before it skips a tick.
+#define SKIP_THRESHOLD 3
+
+/// The fewest ticks between two skipped ticks, so that the other peer has
+/// time to hear about the first.
+#define SKIP_INTERVAL 8
+
+/// The length of a tick, in nanoseconds.
+#define TICK_NS (1000000000 / 60)
+
+/// The magic number at the start of each packet.
+static const unsigned char packet_magic[4] = {'T', 'T', 'N', 'P'};
+
+/// A packet that is being held back to simulate latency.
+struct HeldPacket
+{
+    /// The clock value when the packet should be sent, in milliseconds.
+    uint32_t send_time;
+
+    /// The size of the packet, in bytes.
+    size_t size;
+
+    /// The packet's contents.
+    unsigned char data[MAX_PACKET_SIZE];
+};
+
+struct Netplay
+{
+    /// The socket.
+    NetSocket socket;
+
+    /// The other peer's address.
+    struct sockaddr_storage peer;
+
+    /// The size of \a peer.
+    socklen_t peer_size;
+
+    /// The session's settings.
+    struct NetplayOptions options;
+
+    /// The low 32 bits of the game's seed.
+    uint32_t seed_check;
+
+    /// The performance counter value when the session was opened.
+    Uint64 start;
+
+    /// The game.
+    struct RollbackSession session;
+
+    /// The number of local inputs the other peer has acknowledged.
+    uint32_t acknowledged;
+
+    /// The other peer's next tick, as of its latest packet.
+    uint32_t remote_tick;
+
+    /// How many ticks the other peer is ahead, as of its latest packet.
+    int remote_advantage;
+
+    /// The other peer's input delay, in ticks.
+    unsigned remote_delay;
+
+    /// The latest clock value received from the other peer, or zero.
+    uint32_t echo;
+
+    /// The local clock value when \a echo was received.
+    uint32_t echo_received;
+
+    /// Whether a packet has arrived from the other peer.
+    bool connected;
+
+    /// Whether the session is waiting for the other peer's inputs.
+    bool waiting;
+
+    /// The tick at which the session last skipped a tick to let the other
+    /// peer catch up.
+    uint32_t last_skip;
+
+    /// The generator for the jitter.
+    struct Rng rng;
+
+    /// The packets being held back, in the order they were queued.
+    struct HeldPacket held[MAX_HELD_PACKETS];
+
+    /// The number of packets in \a held.
+    size_t held_count;
+
+    /// The number of packets dropped because \a held was full, or that
+    /// could not be sent.
+    uint64_t dropped;
+
+    /// The number of invalid packets received.
+    uint64_t rejected;
+
+    /// The number of ticks skipped waiting for the other peer's inputs.
+    uint64_t stalls;
+
+    /// The number of ticks skipped to let the other peer catch up.
+    uint64_t skips;
+
+    /// The round trip times.
+    struct Histogram round_trip;
+
+    /// How long after the other player's inputs were read they took effect
+    /// on this machine, counting their input delay.
+    struct Histogram remote_latency;
+};
+
+/// Gets the session's clock. It starts at one, so that zero can mean that no
+/// clock value has been received.
+/// \param[in]  netplay The session.
+/// \returns    The time since the session was opened, in milliseconds.
+static uint32_t now_ms(const struct Netplay *netplay)
+{
+    Uint64 elapsed = SDL_GetPerformanceCounter() - netplay->start;
+    return (uint32_t)(elapsed * 1000 / SDL_GetPerformanceFrequency()) + 1;
+}
+
+/// Checks whether the last receive failed because an earlier packet was
+/// refused, which is expected until the other peer starts.
+/// \returns    True if the error can be ignored, false otherwise.
+static bool refused(void)
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAECONNRESET;
+#else
+    return errno == ECONNREFUSED;
+#endif
+}
+
+/// Sends a packet straight away.
+/// \param[in,out]  netplay The session.
+/// \param[in]      data    The packet.
+/// \param[in]      size    The size of the packet, in bytes.
+static void send_now(struct Netplay *netplay, const unsigned char *data, size_t size)
+{
+    if (sendto(
+            netplay->socket,
+            (const char *)data,
+            (int)size,
+            0,
+            (const struct sockaddr *)&netplay->peer,
+            netplay->peer_size) < 0)
+        ++netplay->dropped;
+}
+
+/// Sends a packet, or holds it back if latency is being simulated.
+/// \param[in,out]  netplay The session.
+/// \param[in]      data    The packet.
+/// \param[in]      size    The size of the packet, in bytes.
+static void send_packet(struct Netplay *netplay, const unsigned char *data, size_t size)
+{
+    const struct NetplayOptions *options = &netplay->options;
+    if (options->latency == 0 && options->jitter == 0)
+    {
+        send_now(netplay, data, size);
+        return;
+    }
+    if (netplay->held_count == MAX_HELD_PACKETS)
+    {
+        ++netplay->dropped;
+        return;
+    }
+
+    struct HeldPacket *held = &netplay->held[netplay->held_count++];
+    held->send_time = now_ms(netplay) + options->latency;
+    if (options->jitter > 0)
+        held->send_time += rng_range(&netplay->rng, options->jitter + 1);
+    held->size = size;
+    memcpy(held->data, data, size);
+}
+
+/// Sends every held-back packet that is due. With jitter, packets can be
+/// due out of order, as they might be on a real network.
+/// \param[in,out]  netplay The session.
+static void send_held_packets(struct Netplay *netplay)
+{
+    uint32_t now = now_ms(netplay);
+    size_t kept = 0;
+    for (size_t i = 0; i < netplay->held_count; ++i)
+    {
+        struct HeldPacket *held = &netplay->held[i];
+        if ((int32_t)(now - held->send_time) >= 0)
+            send_now(netplay, held->data, held->size);
+        else if (kept++ != i)
+            netplay->held[kept - 1] = *held;
+    }
+    netplay->held_count = kept;
+}
+
+/// Builds and sends a packet with every local input the other peer has not
+/// acknowledged.
+/// \param[in,out]  netplay The session.
+static void send_inputs(struct Netplay *netplay)
+{
+    const struct RollbackSession *session = &netplay->session;
+    uint32_t first = netplay->acknowledged;
+    uint32_t count = session->local_count - first;
+    if (count > MAX_PACKET_INPUTS)
+        count = MAX_PACKET_INPUTS;
+
+    int advantage = (int)(session->tick - netplay->remote_tick);
+    if (advantage > 127)
+        advantage = 127;
+    if (advantage < -127)
+        advantage = -127;
+
+    uint32_t now = now_ms(netplay);
+    uint32_t hold = netplay->echo ? now - netplay->echo_received : 0;
+    unsigned char packet[MAX_PACKET_SIZE];
+    memcpy(packet, packet_magic, sizeof(packet_magic));
+    packet[4] = PROTOCOL_VERSION;
+    packet[5] = (unsigned char)session->local_player;
+    packet[6] = (unsigned char)session->input_delay;
+    packet[7] = (unsigned char)count;
+    bytes_store_le(packet + 8, netplay->seed_check, 4);
+    bytes_store_le(packet + 12, session->tick, 4);
+    bytes_store_le(packet + 16, session->remote_count, 4);
+    bytes_store_le(packet + 20, now, 4);
+    bytes_store_le(packet + 24, netplay->echo, 4);
+    bytes_store_le(packet + 28, hold > 0xFFFF ? 0xFFFF : hold, 2);
+    packet[30] = (unsigned char)(signed char)advantage;
+    packet[31] = 0;
+    bytes_store_le(packet + 32, first, 4);
+    for (uint32_t i = 0; i < count; ++i)
+        packet[HEADER_SIZE + i] = (unsigned char)session->local[(first + i) % RB_WINDOW];
+    send_packet(netplay, packet, HEADER_SIZE + count);
+}
+
+/// Handles a packet from the other peer.
+/// \param[in,out]  netplay The session.
+/// \param[in]      packet  The packet.
+/// \param[in]      size    The size of the packet, in bytes.
+static void receive_packet(struct Netplay *netplay, const unsigned char *packet, size_t size)
+{
+    struct RollbackSession *session = &netplay->session;
+    size_t remote_player = 1 - session->local_player;
+    if (size < HEADER_SIZE
+        || memcmp(packet, packet_magic, sizeof(packet_magic)) != 0
+        || packet[4] != PROTOCOL_VERSION
+        || size != HEADER_SIZE + (size_t)packet[7])
+    {
+        ++netplay->rejected;
+        return;
+    }
+    if (bytes_load_le(packet + 8, 4) != netplay->seed_check
+        || packet[5] != remote_player)
+    {
+        if (netplay->rejected++ == 0)
+        {
+            SDL_LogError(
+                SDL_LOG_CATEGORY_APPLICATION,
+                "The other peer is using a different seed or is also "
+                "player %u",
+                (unsigned)session->local_player + 1u);
+        }
+        return;
+    }
+
+    if (!netplay->connected)
+    {
+        SDL_Log("Connected to '%s'", netplay->options.peer);
+        netplay->connected = true;
+    }
+
+    uint32_t now = now_ms(netplay);
+    uint32_t acknowledged = (uint32_t)bytes_load_le(packet + 16, 4);
+    if (acknowledged > netplay->acknowledged && acknowledged <= session->local_count)
+        netplay->acknowledged = acknowledged;
+    uint32_t remote_tick = (uint32_t)bytes_load_le(packet + 12, 4);
+    if (remote_tick >= netplay->remote_tick)
+    {
+        netplay->remote_tick = remote_tick;
+        netplay->remote_advantage = (signed char)packet[30];
+        netplay->remote_delay = packet[6];
+    }
+
+    uint32_t timestamp = (uint32_t)bytes_load_le(packet + 20, 4);
+    if ((int32_t)(timestamp - netplay->echo) > 0)
+    {
+        netplay->echo = timestamp;
+        netplay->echo_received = now;
+    }
+    uint32_t echo = (uint32_t)bytes_load_le(packet + 24, 4);
+    if (echo != 0)
+    {
+        uint32_t round_trip = now - echo - (uint32_t)bytes_load_le(packet + 28, 2);
+        if ((int32_t)round_trip >= 0)
+            st_add(&netplay->round_trip, (uint64_t)round_trip * 1000000);
+    }
+
+    uint32_t first = (uint32_t)bytes_load_le(packet + 32, 4);
+    for (size_t i = 0; i < packet[7]; ++i)
+    {
+        uint32_t tick = first + (uint32_t)i;
+        uint32_t current = session->tick;
+        if (!rb_add_remote_input(session, tick, (PlayerInput)packet[HEADER_SIZE + i]))
+            continue;
+
+        // The input was read remote_delay ticks before it was due, and takes
+        // effect here at that tick or, if it arrived late, at the rollback
+        uint32_t late = current > tick ? current - tick : 0;
+        st_add(
+            &netplay->remote_latency,
+            (uint64_t)(late + netplay->remote_delay) * TICK_NS);
+    }
+}
+
+/// Splits "host:port" into its parts. IPv6 addresses can be given in
+/// brackets, as in "[::1]:7000".
+/// \param[in]  address The address.
+/// \param[out] host    Receives the host.
+/// \param[in]  size    The size of \a host, in bytes.
+/// \param[out] port    Receives the port.
+/// \returns    True if successful, false if the address is malformed.
+static bool split_address(const char *address, char *host, size_t size, const char **port)
+{
+    const char *colon = strrchr(address, ':');
+    if (!colon || colon[1] == '\0')
+        return false;
+
+    const char *start = address;
+    const char *end = colon;
+    if (*start == '[' && end > start && end[-1] == ']')
+    {
+        ++start;
+        --end;
+    }
+    if (end == start || (size_t)(end - start) >= size)
+        return false;
+
+    memcpy(host, start, (size_t)(end - start));
+    host[end - start] = '\0';
+    *port = colon + 1;
+    return true;
+}
+
+/// Creates a non-blocking UDP socket bound to the local port, of the same
+/// family as the other peer's address.
+/// \param[in,out]  netplay The session, whose \a peer is set.
+/// \returns    True if successful, false otherwise.
+static bool open_socket(struct Netplay *netplay)
+{
+    char port[8];
+    snprintf(port, sizeof(port), "%u", (unsigned)netplay->options.local_port);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = netplay->peer.ss_family;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_PASSIVE;
+    struct addrinfo *local;
+    if (getaddrinfo(NULL, port, &hints, &local) != 0)
+        return false;
+
+    netplay->socket = socket(local->ai_family, SOCK_DGRAM, 0);
+    bool successful = netplay->socket != INVALID_NET_SOCKET
+        && bind(netplay->socket, local->ai_addr, (socklen_t)local->ai_addrlen) == 0;
+    freeaddrinfo(local);
+    if (!successful)
+        return false;
+
+#ifdef _WIN32
+    u_long non_blocking = 1;
+    return ioctlsocket(netplay->socket, FIONBIO, &non_blocking) == 0;
+#else
+    int flags = fcntl(netplay->socket, F_GETFL, 0);
+    return flags >= 0 && fcntl(netplay->socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+struct Netplay *np_open(const struct NetplayOptions *options, uint64_t seed)
+{
+    char host[256];
+    const char *port;
+    if (!split_address(options->peer, host, sizeof(host), &port))
+    {
+        SDL_LogError(
+            SDL_LOG_CATEGORY_APPLICATION,
+            "Invalid peer address '%s'; expected <host>:<port>",
+            options->peer);
+        return NULL;
+    }
+
+    struct Netplay *netplay = calloc(1, sizeof(*netplay));
+    if (!netplay)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Out of memory");
+        return NULL;
+    }
+    netplay->socket = INVALID_NET_SOCKET;
+
+#ifdef _WIN32
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to start Winsock");
+        free(netplay);
+        return NULL;
+    }
+#endif
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    struct addrinfo *peer;
+    if (getaddrinfo(host, port, &hints, &peer) != 0)
+    {
+        SDL_LogError(
+            SDL_LOG_CATEGORY_APPLICATION,
+            "Could not resolve '%s'",
+            options->peer);
+        np_close(netplay);
+        return NULL;
+    }
+    memcpy(&netplay->peer, peer->ai_addr, peer->ai_addrlen);
+    netplay->peer_size = (socklen_t)peer->ai_addrlen;
+    freeaddrinfo(peer);
+
+    netplay->options = *options;
+    if (!open_socket(netplay))
+    {
+        SDL_LogError(
+            SDL_LOG_CATEGORY_APPLICATION,
+            "Could not listen on UDP port %u",
+            (unsigned)options->local_port);
+        np_close(netplay);
+        return NULL;
+    }
+
+    netplay->seed_check = (uint32_t)seed;
+    netplay->start = SDL_GetPerformanceCounter();
+    rng_seed(&netplay->rng, seed ^ options->local_port);
+    rb_init(&netplay->session, seed, options->local_player, options->input_delay);
+    SDL_Log(
+        "Playing as player %u on UDP port %u with %u ticks of input delay; "
+        "waiting for '%s'",
+        (unsigned)options->local_player + 1u,
+        (unsigned)options->local_port,
+        options->input_delay,
+        options->peer);
+    return netplay;
+}
+
+void np_poll(struct Netplay *netplay)
+{
+    send_held_packets(netplay);
+
+    unsigned char packet[MAX_PACKET_SIZE + 1];
+    for (;;)
+    {
+        int size = (int)recvfrom(
+            netplay->socket,
+            (char *)packet,
+            (int)sizeof(packet),
+            0,
+            NULL,
+            NULL);
+        if (size < 0)
+        {
+            // Otherwise, there are no more packets
+            if (refused())
+                continue;
+            break;
+        }
+        receive_packet(netplay, packet, (size_t)size);
+    }
+}
+
+bool np_advance(struct Netplay *netplay, PlayerInput input, struct GameEvents *events)
+{
+    struct RollbackSession *session = &netplay->session;
+    bool advanced = false;
+    // The next local input would overwrite the oldest one in the ring, which
+    // must not happen until the other peer has acknowledged it, or it would
+    // be resent with the wrong value
+    bool ring_full =
+        session->local_count + 1 - netplay->acknowledged > RB_WINDOW;
+    if (!rb_ready(session) || ring_full)
+    {
+        if (!netplay->waiting)
+        {
+            SDL_Log(
+                "Waiting for player %u",
+                (unsigned)(1 - session->local_player) + 1u);
+        }
+        netplay->waiting = true;
+        ++netplay->stalls;
+    }
+    else if (netplay->connected
+        && (int)(session->tick - netplay->remote_tick) - netplay->remote_advantage
+            >= SKIP_THRESHOLD
+        && session->tick - netplay->last_skip >= SKIP_INTERVAL)
+    {
+        netplay->last_skip = session->tick;
+        ++netplay->skips;
+    }
+    else
+    {
+        netplay->waiting = false;
+        rb_add_local_input(session, input);
+        rb_advance(session, events);
+        advanced = true;
+    }
+
+    send_inputs(netplay);
+    return advanced;
+}
+
+const struct GameState *np_state(const struct Netplay *netplay)
+{
+    return rb_state(&netplay->session);
+}
+
+void np_report(const struct Netplay *netplay)
+{
+    const struct RollbackStats *stats = &netplay->session.stats;
+    SDL_Log(
+        "Local input latency: %u ticks (%.1f ms; local play has none)",
+        netplay->session.input_delay,
+        netplay->session.input_delay * 1000.0 / 60.0);
+    SDL_Log(
+        "Remote input latency: p50 %.1f ms, p99 %.1f ms, max %.1f ms",
+        st_percentile(&netplay->remote_latency, 50.0) / 1e6,
+        st_percentile(&netplay->remote_latency, 99.0) / 1e6,
+        netplay->remote_latency.max / 1e6);
+    SDL_Log(
+        "Round trip: p50 %.1f ms, p99 %.1f ms, max %.1f ms",
+        st_percentile(&netplay->round_trip, 50.0) / 1e6,
+        st_percentile(&netplay->round_trip, 99.0) / 1e6,
+        netplay->round_trip.max / 1e6);
+    SDL_Log(
+        "%llu ticks, %llu rollbacks (%llu ticks re-simulated, at most %u at "
+        "once), %llu of %llu predictions wrong",
+        (unsigned long long)stats->ticks,
+        (unsigned long long)stats->rollbacks,
+        (unsigned long long)stats->resimulated,
+        stats->max_depth,
+        (unsigned long long)stats->mispredicted,
+        (unsigned long long)stats->predicted);
+    SDL_Log(
+        "%llu ticks waiting for inputs, %llu ticks skipped to stay in step, "
+        "%llu packets dropped, %llu rejected",
+        (unsigned long long)netplay->stalls,
+        (unsigned long long)netplay->skips,
+        (unsigned long long)netplay->dropped,
+        (unsigned long long)netplay->rejected);
+}
+
+void np_close(struct Netplay *netplay)
+{
+    if (!netplay)
+        return;
+
+    if (netplay->socket != INVALID_NET_SOCKET)
+        close_socket(netplay->socket);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    free(netplay);
+}
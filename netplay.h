@@ -0,0 +1,104 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Functionality exported by the netplay module.
+///
+/// Plays against another instance of the game over UDP. Each tick, a peer
+/// sends every local input the other peer has not yet acknowledged, so a
+/// lost packet is made up for by the next one, and the rollback module hides
+/// the time the inputs take to arrive. For testing, outgoing packets can be
+/// held back by a fixed latency plus a random jitter.
+
+#include "game.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// The highest accepted artificial latency or jitter, in milliseconds.
+#define NP_MAX_LATENCY 1000
+
+/// Settings for a netplay session.
+struct NetplayOptions
+{
+    /// The address of the other peer, as "host:port", or NULL to play
+    /// locally.
+    const char *peer;
+
+    /// The UDP port to listen on.
+    unsigned short local_port;
+
+    /// The index of the player controlled on this machine.
+    size_t local_player;
+
+    /// The number of ticks between reading a local input and using it.
+    unsigned input_delay;
+
+    /// The time each outgoing packet is held back for, in milliseconds.
+    unsigned latency;
+
+    /// The most extra time, chosen at random, each outgoing packet is held
+    /// back for, in milliseconds.
+    unsigned jitter;
+};
+
+/// A netplay session.
+struct Netplay;
+
+/// Opens the session's socket. The game starts straight away; the peers find
+/// each other once both are running.
+/// \param[in]  options The session's settings.
+/// \param[in]  seed    The game's seed, which must be the same on both peers.
+/// \returns    The session, or NULL on failure.
+struct Netplay *np_open(const struct NetplayOptions *options, uint64_t seed);
+
+/// Sends any held-back packets that are due and handles every packet that
+/// has arrived. Call it once per frame.
+/// \param[in,out]  netplay The session.
+void np_poll(struct Netplay *netplay);
+
+/// Simulates the next tick, unless the session has predicted too far ahead
+/// of the other peer, has more local inputs waiting to be acknowledged than
+/// it keeps, or is running ahead of the other peer and has to let it catch
+/// up.
+/// Either way, the local input is sent.
+/// \param[in,out]  netplay The session.
+/// \param[in]      input   The local player's input.
+/// \param[out]     events  Buffer that receives the events of the tick, or
+///                         NULL.
+/// \returns    True if a tick was simulated, false if the session waited.
+bool np_advance(struct Netplay *netplay, PlayerInput input, struct GameEvents *events);
+
+/// Gets the state after the last simulated tick.
+/// \param[in]  netplay The session.
+/// \returns    The current state.
+const struct GameState *np_state(const struct Netplay *netplay);
+
+/// Logs the session's round trip time, how late the remote player's inputs
+/// arrived, and how often the session rolled back.
+/// \param[in]  netplay The session.
+void np_report(const struct Netplay *netplay);
+
+/// Closes the session's socket and frees it.
+/// \param[in]  netplay The session, or NULL.
+void np_close(struct Netplay *netplay);
+
+#endif
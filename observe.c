@@ -0,0 +1,303 @@
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Implementation of the observation module.
+///
+/// Each state is drawn in grey, one byte per pixel, at the display
+/// resolution. Reducing the image is then done in two passes. The horizontal
+/// pass sums each row into the output columns, reusing the previous row's
+/// sums when the rows are the same, which most are. The vertical pass sums
+/// those rows into the output rows. Positions are measured in
+/// units of 1/width of a display pixel horizontally (1/height vertically),
+/// so every overlap between a display pixel and an output pixel is a whole
+/// number and the averages are exact.
+
+#include "observe.h"
+#include "constants.h"
+#include "pool.h"
+#include "scene.h"
+#include <stdlib.h>
+#include <string.h>
+
+/// The number of states a worker draws at a time.
+#define GRAIN 16
+
+/// The display pixels that contribute to each output pixel along one axis.
+struct Taps
+{
+    /// The first display pixel contributing to each output pixel.
+    int *first;
+
+    /// The number of display pixels contributing to each output pixel.
+    int *count;
+
+    /// The weights of the contributing display pixels, for each output pixel
+    /// in turn. The weights for one output pixel add up to the display size
+    /// along this axis.
+    uint32_t *weights;
+};
+
+/// A worker's drawing buffers.
+struct Scratch
+{
+    /// The full-size frame, in grey.
+    uint8_t *pixels;
+
+    /// The frame after the horizontal pass: DISPLAY_HEIGHT rows of the
+    /// output width.
+    uint32_t *columns;
+};
+
+/// The state shared by the workers of one obs_render() call.
+struct Observer
+{
+    /// The states to observe.
+    const struct GameState *states;
+
+    /// The width of each observation.
+    int width;
+
+    /// The height of each observation.
+    int height;
+
+    /// The horizontal taps.
+    struct Taps x_taps;
+
+    /// The vertical taps.
+    struct Taps y_taps;
+
+    /// One set of buffers per worker.
+    struct Scratch *scratch;
+
+    /// Receives the observations.
+    uint8_t *observations;
+};
+
+/// Works out how display pixels map to output pixels along one axis.
+/// \param[out] taps    The taps to initialize.
+/// \param[in]  source  The display size along the axis.
+/// \param[in]  size    The output size along the axis.
+/// \returns    True if successful, false if memory could not be allocated.
+static bool init_taps(struct Taps *taps, int source, int size)
+{
+    taps->first = malloc((size_t)size * sizeof(int));
+    taps->count = malloc((size_t)size * sizeof(int));
+    // Each output pixel overlaps at most one more display pixel than it
+    // covers
+    taps->weights = malloc(((size_t)source + (size_t)size) * sizeof(uint32_t));
+    if (!taps->first || !taps->count || !taps->weights)
+        return false;
+
+    size_t weight = 0;
+    for (int i = 0; i < size; ++i)
+    {
+        int begin = i * source;
+        int end = begin + source;
+        taps->first[i] = begin / size;
+        taps->count[i] = (end - 1) / size - taps->first[i] + 1;
+        for (int pixel = taps->first[i]; pixel * size < end; ++pixel)
+        {
+            int pixel_begin = pixel * size;
+            int pixel_end = pixel_begin + size;
+            int overlap_begin = pixel_begin > begin ? pixel_begin : begin;
+            int overlap_end = pixel_end < end ? pixel_end : end;
+            taps->weights[weight++] = (uint32_t)(overlap_end - overlap_begin);
+        }
+    }
+    return true;
+}
+
+/// Releases the memory used by taps.
+/// \param[in]  taps    The taps.
+static void free_taps(struct Taps *taps)
+{
+    free(taps->first);
+    free(taps->count);
+    free(taps->weights);
+}
+
+/// Converts a colour to grey, using the BT.601 luma weights.
+/// \param[in]  color   The colour, as 0xAARRGGBB.
+/// \returns    The grey level.
+static uint8_t grey(uint32_t color)
+{
+    uint32_t r = color >> 16 & 0xFF;
+    uint32_t g = color >> 8 & 0xFF;
+    uint32_t b = color & 0xFF;
+    return (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+}
+
+/// Draws a scene in grey at the display resolution.
+/// \param[in]  scene   The scene.
+/// \param[out] pixels  Receives the frame.
+static void draw_grey(const struct Scene *scene, uint8_t *pixels)
+{
+    for (size_t i = 0; i < scene->count; ++i)
+    {
+        const struct SceneRect *rect = &scene->rects[i];
+        int left = rect->x > 0 ? rect->x : 0;
+        int top = rect->y > 0 ? rect->y : 0;
+        int right = rect->x + rect->w < DISPLAY_WIDTH
+            ? rect->x + rect->w
+            : DISPLAY_WIDTH;
+        int bottom = rect->y + rect->h < DISPLAY_HEIGHT
+            ? rect->y + rect->h
+            : DISPLAY_HEIGHT;
+        if (left >= right || top >= bottom)
+            continue;
+
+        uint8_t level = grey(rect->color);
+        for (int y = top; y < bottom; ++y)
+            memset(pixels + y * DISPLAY_WIDTH + left, level, (size_t)(right - left));
+    }
+}
+
+/// Reduces a frame drawn in grey to an observation.
+/// \param[in]  observer    The observer.
+/// \param[in]  scratch     The buffers holding the frame.
+/// \param[out] observation Receives the observation.
+static void reduce(
+    const struct Observer *observer,
+    struct Scratch *scratch,
+    uint8_t *observation)
+{
+    const int width = observer->width;
+    const int height = observer->height;
+    for (int y = 0; y < DISPLAY_HEIGHT; ++y)
+    {
+        const uint8_t *row = scratch->pixels + y * DISPLAY_WIDTH;
+        uint32_t *columns = scratch->columns + (size_t)y * (size_t)width;
+        if (y > 0 && memcmp(row, row - DISPLAY_WIDTH, DISPLAY_WIDTH) == 0)
+        {
+            memcpy(columns, columns - width, (size_t)width * sizeof(uint32_t));
+            continue;
+        }
+
+        const uint32_t *weight = observer->x_taps.weights;
+        for (int x = 0; x < width; ++x)
+        {
+            const uint8_t *tap = row + observer->x_taps.first[x];
+            uint32_t sum = 0;
+            for (int i = 0; i < observer->x_taps.count[x]; ++i)
+                sum += tap[i] * *weight++;
+            columns[x] = sum;
+        }
+    }
+
+    // The largest total is 255 * DISPLAY_WIDTH * DISPLAY_HEIGHT, which fits
+    const uint32_t area = (uint32_t)DISPLAY_WIDTH * DISPLAY_HEIGHT;
+    const uint32_t *weight = observer->y_taps.weights;
+    for (int y = 0; y < height; ++y)
+    {
+        uint8_t *out = observation + (size_t)y * (size_t)width;
+        const uint32_t *first_row = scratch->columns
+            + (size_t)observer->y_taps.first[y] * (size_t)width;
+        uint32_t sums[DISPLAY_WIDTH] = {0};
+        for (int i = 0; i < observer->y_taps.count[y]; ++i)
+        {
+            const uint32_t *columns = first_row + (size_t)i * (size_t)width;
+            uint32_t row_weight = *weight++;
+            for (int x = 0; x < width; ++x)
+                sums[x] += columns[x] * row_weight;
+        }
+        for (int x = 0; x < width; ++x)
+            out[x] = (uint8_t)((sums[x] + area / 2) / area);
+    }
+}
+
+/// Draws a range of observations; called by the thread pool.
+/// \param[in]  context The observer.
+/// \param[in]  begin   The index of the first state.
+/// \param[in]  end     One past the index of the last state.
+/// \param[in]  worker  The index of the calling worker.
+static void observe_range(void *context, size_t begin, size_t end, unsigned worker)
+{
+    const struct Observer *observer = context;
+    struct Scratch *scratch = &observer->scratch[worker];
+    const size_t size = (size_t)observer->width * (size_t)observer->height;
+    struct Scene scene;
+    for (size_t i = begin; i < end; ++i)
+    {
+        sc_clear(&scene);
+        sc_add_frame(&scene, &observer->states[i]);
+        draw_grey(&scene, scratch->pixels);
+        reduce(observer, scratch, observer->observations + i * size);
+    }
+}
+
+bool obs_render(
+    const struct GameState *states,
+    size_t count,
+    int width,
+    int height,
+    unsigned thread_count,
+    uint8_t *observations)
+{
+    if (width < 1 || width > DISPLAY_WIDTH || height < 1 || height > DISPLAY_HEIGHT)
+        return false;
+    if (count == 0)
+        return true;
+
+    if (thread_count == 0)
+        thread_count = pool_default_threads();
+    size_t batches = (count + GRAIN - 1) / GRAIN;
+    if (thread_count > batches)
+        thread_count = (unsigned)batches;
+
+    struct Observer observer =
+    {
+        states, width, height, {NULL, NULL, NULL}, {NULL, NULL, NULL}, NULL,
+        observations
+    };
+    observer.scratch = calloc(thread_count, sizeof(struct Scratch));
+    bool successful = observer.scratch
+        && init_taps(&observer.x_taps, DISPLAY_WIDTH, width)
+        && init_taps(&observer.y_taps, DISPLAY_HEIGHT, height);
+    for (unsigned i = 0; successful && i < thread_count; ++i)
+    {
+        struct Scratch *scratch = &observer.scratch[i];
+        scratch->columns = malloc(
+            (size_t)DISPLAY_HEIGHT * (size_t)width * sizeof(uint32_t));
+        scratch->pixels = malloc((size_t)DISPLAY_WIDTH * DISPLAY_HEIGHT);
+        successful = scratch->columns && scratch->pixels;
+    }
+
+    if (successful)
+    {
+        successful = pool_run(
+            count,
+            thread_count,
+            GRAIN,
+            observe_range,
+            &observer);
+    }
+
+    if (observer.scratch)
+    {
+        for (unsigned i = 0; i < thread_count; ++i)
+        {
+            free(observer.scratch[i].columns);
+            free(observer.scratch[i].pixels);
+        }
+        free(observer.scratch);
+    }
+    free_taps(&observer.x_taps);
+    free_taps(&observer.y_taps);
+    return successful;
+}
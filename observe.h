@@ -0,0 +1,59 @@
+#ifndef OBSERVE_H
+#define OBSERVE_H
+
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Functionality exported by the observation module.
+///
+/// Observations are small greyscale images of game states, for agents that
+/// learn from pixels. They are drawn with the same scene as r_draw_frame(),
+/// in memory, without a window or an SDL renderer.
+
+#include "game.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Draws a greyscale observation of each of several game states, in
+/// parallel. Each state is drawn at the display resolution and then reduced
+/// to \a width by \a height by averaging the area each output pixel covers,
+/// so thin lines fade rather than disappear.
+/// \param[in]  states          The states to observe.
+/// \param[in]  count           The number of states.
+/// \param[in]  width           The width of each observation, from 1 to
+///                             DISPLAY_WIDTH.
+/// \param[in]  height          The height of each observation, from 1 to
+///                             DISPLAY_HEIGHT.
+/// \param[in]  thread_count    The number of threads to use, including the
+///                             calling thread. Zero uses one per CPU.
+/// \param[out] observations    Receives \a count observations one after
+///                             another, each \a height rows of \a width
+///                             bytes, from 0 (black) to 255 (white).
+/// \returns    True if successful, false if the size is out of range or
+///             memory or threads could not be allocated.
+bool obs_render(
+    const struct GameState *states,
+    size_t count,
+    int width,
+    int height,
+    unsigned thread_count,
+    uint8_t *observations);
+
+#endif
@@ -0,0 +1,141 @@
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Implementation of the frame pacer module.
+
+#include "pacer.h"
+#include <string.h>
+
+/// The initial spin margin, in microseconds.
+#define INITIAL_SPIN_US 2000
+
+/// The smallest spin margin, in microseconds.
+#define MIN_SPIN_US 250
+
+/// The largest spin margin, in microseconds.
+#define MAX_SPIN_US 4000
+
+/// Converts microseconds to performance counter ticks.
+/// \param[in]  pacer   The pacer.
+/// \param[in]  us      The time, in microseconds.
+/// \returns    The time, in performance counter ticks.
+static Uint64 us_to_ticks(const struct Pacer *pacer, Uint64 us)
+{
+    return pacer->frequency * us / 1000000;
+}
+
+/// Converts performance counter ticks to nanoseconds.
+/// \param[in]  pacer   The pacer.
+/// \param[in]  ticks   The time, in performance counter ticks.
+/// \returns    The time, in nanoseconds.
+static Uint64 ticks_to_ns(const struct Pacer *pacer, Uint64 ticks)
+{
+    return (Uint64)((double)ticks * 1e9 / pacer->frequency);
+}
+
+/// Sleeps until shortly before a deadline, then adjusts the spin margin by
+/// how much the sleep overran.
+/// \param[in,out]  pacer   The pacer.
+/// \param[in]      now     The current performance counter value.
+static void sleep_until_margin(struct Pacer *pacer, Uint64 now)
+{
+    if (pacer->deadline - now <= pacer->spin_margin)
+        return;
+
+    Uint64 sleep = pacer->deadline - now - pacer->spin_margin;
+    Uint32 ms = (Uint32)(sleep * 1000 / pacer->frequency);
+    if (ms == 0)
+        return;
+
+    SDL_Delay(ms);
+    Uint64 slept = SDL_GetPerformanceCounter() - now;
+    Uint64 requested = us_to_ticks(pacer, (Uint64)ms * 1000);
+    Uint64 overrun = slept > requested ? slept - requested : 0;
+
+    // Grow quickly to cover a late wake-up, but shrink slowly, so that one
+    // lucky sleep does not cause a missed deadline
+    Uint64 target = overrun + us_to_ticks(pacer, MIN_SPIN_US);
+    if (target > pacer->spin_margin)
+        pacer->spin_margin = target;
+    else
+        pacer->spin_margin -= (pacer->spin_margin - target) / 16;
+
+    Uint64 max_margin = us_to_ticks(pacer, MAX_SPIN_US);
+    if (pacer->spin_margin > max_margin)
+        pacer->spin_margin = max_margin;
+}
+
+void pacer_init(struct Pacer *pacer, unsigned fps)
+{
+    memset(pacer, 0, sizeof(*pacer));
+    pacer->frequency = SDL_GetPerformanceFrequency();
+    pacer->period = fps ? pacer->frequency / fps : 0;
+    pacer->start = SDL_GetPerformanceCounter();
+    pacer->last_frame = pacer->start;
+    pacer->deadline = pacer->start + pacer->period;
+    pacer->spin_margin = us_to_ticks(pacer, INITIAL_SPIN_US);
+}
+
+void pacer_wait(struct Pacer *pacer)
+{
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (pacer->period)
+    {
+        if (now < pacer->deadline)
+        {
+            sleep_until_margin(pacer, now);
+            while ((now = SDL_GetPerformanceCounter()) < pacer->deadline)
+                continue;
+        }
+
+        pacer->deadline += pacer->period;
+        if (now >= pacer->deadline)
+            pacer->deadline = now + pacer->period;
+
+        Uint64 length = now - pacer->last_frame;
+        Uint64 error = length > pacer->period
+            ? length - pacer->period
+            : pacer->period - length;
+        st_add(&pacer->jitter, ticks_to_ns(pacer, error));
+    }
+    pacer->last_frame = now;
+    ++pacer->frames;
+}
+
+void pacer_report(const struct Pacer *pacer)
+{
+    double seconds = (double)(pacer->last_frame - pacer->start)
+        / pacer->frequency;
+    double fps = seconds > 0.0 ? pacer->frames / seconds : 0.0;
+    if (!pacer->period)
+    {
+        SDL_Log("Frame rate: %.1f fps (not limited)", fps);
+        return;
+    }
+
+    SDL_Log(
+        "Frame rate: %.1f fps (target %.1f), jitter p50 %.1f us, "
+        "p99 %.1f us, max %.1f us, spin margin %.1f us",
+        fps,
+        (double)pacer->frequency / pacer->period,
+        st_percentile(&pacer->jitter, 50.0) / 1000.0,
+        st_percentile(&pacer->jitter, 99.0) / 1000.0,
+        pacer->jitter.max / 1000.0,
+        ticks_to_ns(pacer, pacer->spin_margin) / 1000.0);
+}
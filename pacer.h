@@ -0,0 +1,79 @@
+#ifndef PACER_H
+#define PACER_H
+
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Functionality exported by the frame pacer module.
+
+#include "stats.h"
+#include <SDL.h>
+
+/// Limits the rate at which frames are drawn.
+///
+/// The pacer sleeps until shortly before each frame's deadline, then spins
+/// for the rest of the time, because SDL_Delay() can oversleep by a
+/// millisecond or more. The spin margin adapts to how much the sleeps have
+/// overrun recently, so little time is spent spinning on systems with
+/// accurate timers.
+struct Pacer
+{
+    /// The length of a frame, in performance counter ticks, or zero if the
+    /// frame rate is not limited.
+    Uint64 period;
+
+    /// The performance counter frequency.
+    Uint64 frequency;
+
+    /// When the current frame should end.
+    Uint64 deadline;
+
+    /// When the previous frame ended.
+    Uint64 last_frame;
+
+    /// When the first frame started.
+    Uint64 start;
+
+    /// How long before a deadline to stop sleeping and start spinning, in
+    /// performance counter ticks.
+    Uint64 spin_margin;
+
+    /// The number of frames paced.
+    unsigned long frames;
+
+    /// How far each frame's length was from the target, in nanoseconds.
+    struct Histogram jitter;
+};
+
+/// Initializes a frame pacer.
+/// \param[out] pacer   The pacer to initialize.
+/// \param[in]  fps     The target frame rate, or zero to not limit it.
+void pacer_init(struct Pacer *pacer, unsigned fps);
+
+/// Waits until the current frame's deadline. If the deadline has already
+/// passed by more than a frame, the schedule is reset rather than running
+/// frames back to back to catch up.
+/// \param[in,out]  pacer   The pacer.
+void pacer_wait(struct Pacer *pacer);
+
+/// Logs the achieved frame rate and frame time jitter.
+/// \param[in]  pacer   The pacer.
+void pacer_report(const struct Pacer *pacer);
+
+#endif
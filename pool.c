@@ -0,0 +1,215 @@
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Implementation of the thread pool module.
+
+#include "pool.h"
+#include <SDL.h>
+#include <stdlib.h>
+
+struct Pool;
+
+/// A worker thread and the range of items it still has to process.
+struct Worker
+{
+    /// Protects \a begin and \a end.
+    SDL_mutex *lock;
+
+    /// The first unclaimed item in the worker's range.
+    size_t begin;
+
+    /// One past the last item in the worker's range.
+    size_t end;
+
+    /// The worker's index.
+    unsigned index;
+
+    /// The pool the worker belongs to.
+    struct Pool *pool;
+
+    /// The worker's thread, or NULL for the calling thread.
+    SDL_Thread *thread;
+};
+
+/// The state shared by the workers of one pool_run() call.
+struct Pool
+{
+    /// The workers.
+    struct Worker *workers;
+
+    /// The number of workers.
+    unsigned worker_count;
+
+    /// The number of items a worker takes at a time.
+    size_t grain;
+
+    /// The function that processes the items.
+    PoolFunc func;
+
+    /// The context pointer passed to \a func.
+    void *context;
+};
+
+/// Claims the next few items from a worker's own range.
+/// \param[in]  worker  The worker.
+/// \param[out] begin   Receives the first claimed item.
+/// \param[out] end     Receives one past the last claimed item.
+/// \returns    True if any items were claimed, false if the range is empty.
+static bool take_work(struct Worker *worker, size_t *begin, size_t *end)
+{
+    bool found = false;
+    SDL_LockMutex(worker->lock);
+    if (worker->begin < worker->end)
+    {
+        size_t remaining = worker->end - worker->begin;
+        size_t count = remaining < worker->pool->grain
+            ? remaining
+            : worker->pool->grain;
+        *begin = worker->begin;
+        *end = worker->begin + count;
+        worker->begin = *end;
+        found = true;
+    }
+    SDL_UnlockMutex(worker->lock);
+    return found;
+}
+
+/// Moves the second half of another worker's remaining items into a worker's
+/// range.
+/// \param[in]  thief   The worker that has run out of items.
+/// \returns    True if any items were stolen, false if every range is empty.
+static bool steal_work(struct Worker *thief)
+{
+    struct Pool *pool = thief->pool;
+    for (unsigned offset = 1; offset < pool->worker_count; ++offset)
+    {
+        struct Worker *victim =
+            &pool->workers[(thief->index + offset) % pool->worker_count];
+        size_t begin = 0;
+        size_t end = 0;
+
+        SDL_LockMutex(victim->lock);
+        if (victim->begin < victim->end)
+        {
+            size_t remaining = victim->end - victim->begin;
+            begin = victim->begin + remaining / 2;
+            end = victim->end;
+            victim->end = begin;
+        }
+        SDL_UnlockMutex(victim->lock);
+
+        if (begin < end)
+        {
+            SDL_LockMutex(thief->lock);
+            thief->begin = begin;
+            thief->end = end;
+            SDL_UnlockMutex(thief->lock);
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Entry point for worker threads.
+/// \param[in]  data    The worker.
+/// \returns    Zero.
+static int worker_main(void *data)
+{
+    struct Worker *worker = data;
+    struct Pool *pool = worker->pool;
+    do
+    {
+        size_t begin;
+        size_t end;
+        while (take_work(worker, &begin, &end))
+            pool->func(pool->context, begin, end, worker->index);
+    } while (steal_work(worker));
+    return 0;
+}
+
+unsigned pool_default_threads(void)
+{
+    int cpus = SDL_GetCPUCount();
+    return cpus > 0 ? (unsigned)cpus : 1u;
+}
+
+bool pool_run(
+    size_t count,
+    unsigned thread_count,
+    size_t grain,
+    PoolFunc func,
+    void *context)
+{
+    if (thread_count == 0)
+        thread_count = pool_default_threads();
+    if (grain == 0)
+        grain = 1;
+
+    struct Pool pool = { NULL, thread_count, grain, func, context };
+    pool.workers = calloc(thread_count, sizeof(struct Worker));
+    if (!pool.workers)
+        return false;
+
+    bool successful = true;
+    unsigned created = 0;
+    for (; created < thread_count; ++created)
+    {
+        struct Worker *worker = &pool.workers[created];
+        worker->lock = SDL_CreateMutex();
+        if (!worker->lock)
+        {
+            successful = false;
+            break;
+        }
+        worker->begin = count / thread_count * created;
+        worker->end = created + 1 == thread_count
+            ? count
+            : count / thread_count * (created + 1);
+        worker->index = created;
+        worker->pool = &pool;
+    }
+
+    // Worker 0 runs on the calling thread
+    unsigned started = 1;
+    if (successful)
+    {
+        for (; started < thread_count; ++started)
+        {
+            struct Worker *worker = &pool.workers[started];
+            worker->thread = SDL_CreateThread(worker_main, "pool worker", worker);
+            if (!worker->thread)
+            {
+                // The workers that did start will steal the missing ones' items
+                SDL_LogWarn(
+                    SDL_LOG_CATEGORY_APPLICATION,
+                    "Failed to start worker thread: %s",
+                    SDL_GetError());
+                break;
+            }
+        }
+        worker_main(&pool.workers[0]);
+    }
+
+    for (unsigned i = 1; i < started; ++i)
+        SDL_WaitThread(pool.workers[i].thread, NULL);
+    for (unsigned i = 0; i < created; ++i)
+        SDL_DestroyMutex(pool.workers[i].lock);
+    free(pool.workers);
+    return successful;
+}
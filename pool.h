@@ -0,0 +1,61 @@
+#ifndef POOL_H
+#define POOL_H
+
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Functionality exported by the thread pool module.
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// Processes a range of work items.
+/// \param[in]  context The context pointer passed to pool_run().
+/// \param[in]  begin   The index of the first item to process.
+/// \param[in]  end     One past the index of the last item to process.
+/// \param[in]  worker  The index of the calling worker, which is less than
+///                     the thread count passed to pool_run(). No two calls
+///                     with the same worker index run at the same time.
+typedef void (*PoolFunc)(void *context, size_t begin, size_t end, unsigned worker);
+
+/// Processes work items in parallel, returning once all of them are done.
+///
+/// The items are split evenly between the workers up front. A worker that
+/// runs out of items steals the second half of another worker's remaining
+/// items, so uneven item costs do not leave threads idle.
+/// \param[in]  count           The number of work items.
+/// \param[in]  thread_count    The number of workers, including the calling
+///                             thread. Zero uses one per CPU.
+/// \param[in]  grain           The number of items a worker takes at a time.
+/// \param[in]  func            The function that processes the items.
+/// \param[in]  context         A pointer passed to \a func.
+/// \returns    True if successful, false if the workers could not be started.
+bool pool_run(
+    size_t count,
+    unsigned thread_count,
+    size_t grain,
+    PoolFunc func,
+    void *context);
+
+/// Gets the number of workers that pool_run() uses for a thread count of
+/// zero.
+/// \returns    The default number of workers.
+unsigned pool_default_threads(void);
+
+#endif
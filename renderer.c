@@ -18,17 +18,76 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 /// \file
 /// \brief Implementation of the renderer module.
+///
+/// There are two backends. The SDL backend draws with an SDL renderer. When
+/// that renderer supports render targets, everything that does not move is
+/// drawn once into an atlas texture: the background and table, the score
+/// digits and a block of white pixels for solid shapes. With
+/// SDL_RenderGeometry() (SDL 2.0.18 and later), a frame is then a single
+/// textured draw call; otherwise the atlas is drawn with a copy per shape.
+///
+/// The software backend fills the scene's rectangles into a framebuffer in
+/// memory, and uploads it to a streaming texture once per frame when there
+/// is a window to show it in.
 
 #include "renderer.h"
 #include "constants.h"
 #include "coord.h"
+#include "framebuffer.h"
+#include "scene.h"
 #include "util.h"
 #include <SDL.h>
 #include <stddef.h>
-#include <stdio.h>
 
-/// The thickness of the score numbers, in pixels.
-#define SCORE_THICKNESS 3
+/// Whether SDL_RenderGeometry() is available.
+#define HAVE_RENDER_GEOMETRY SDL_VERSION_ATLEAST(2, 0, 18)
+
+/// The left edge of the statistics chart.
+#define STATS_X (SC_SCORE_THICKNESS * 12)
+
+/// The width of the statistics chart.
+#define STATS_WIDTH (DISPLAY_WIDTH - STATS_X * 2)
+
+/// The height of each row of the statistics chart.
+#define STATS_ROW_HEIGHT 3
+
+/// The number of nanoseconds represented by one pixel of a chart bar.
+#define STATS_NS_PER_PIXEL 100000
+
+/// The colour of the 60 Hz frame budget tick, as 0xAARRGGBB.
+#define STATS_COLOR_BUDGET 0xFF808080u
+
+/// The colour of the 99th percentile bars, as 0xAARRGGBB.
+#define STATS_COLOR_P99 0xFF6060A0u
+
+/// The colour of the median bars, as 0xAARRGGBB.
+#define STATS_COLOR_P50 0xFFFFFFFFu
+
+/// The colour of the maximum ticks, as 0xAARRGGBB.
+#define STATS_COLOR_MAX 0xFFFF4040u
+
+/// The length of a frame at 60 Hz, in nanoseconds.
+#define FRAME_BUDGET_NS (1000000000 / 60)
+
+/// The Y coordinate of the score digits in the atlas. The background and
+/// table fill the atlas above them.
+#define ATLAS_GLYPH_Y DISPLAY_HEIGHT
+
+/// The X coordinate of the block of white pixels in the atlas.
+#define ATLAS_WHITE_X (SC_GLYPH_WIDTH * 10)
+
+/// The width and height of the block of white pixels in the atlas.
+#define ATLAS_WHITE_SIZE 2
+
+/// The width of the atlas.
+#define ATLAS_WIDTH DISPLAY_WIDTH
+
+/// The height of the atlas.
+#define ATLAS_HEIGHT (DISPLAY_HEIGHT + SC_GLYPH_HEIGHT)
+
+/// The most quads in a frame: the table, two digits per score, the ball and
+/// the paddles.
+#define MAX_QUADS (1 + PLAYER_COUNT * 2 + 1 + PLAYER_COUNT)
 
 /// Displays an SDL error and returns false if \a expr is not zero.
 /// \param  expr    The expression to check.
@@ -37,55 +96,107 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
     return false;\
 }
 
-/// The table rectangle.
-static const SDL_Rect table =
+/// The whole screen, which is also where the background and table are in
+/// the atlas.
+static const SDL_Rect screen =
 {
-    0, TABLE_Y,
-    TABLE_WIDTH, TABLE_HEIGHT
+    0, 0,
+    DISPLAY_WIDTH, DISPLAY_HEIGHT
 };
 
-static bool draw_paddles(const struct PlayerState *players);
-
-static bool draw_table(void);
+/// The digits drawn for a player's score, which are only recalculated when
+/// the score changes.
+struct ScoreCache
+{
+    /// The score the digits were calculated for, or -1 if none.
+    int score;
 
-static bool draw_score(unsigned score, int x);
+    /// The number of digits.
+    int digit_count;
 
-static bool draw_0(int x);
-static bool draw_1(int x);
-static bool draw_2(int x);
-static bool draw_3(int x);
-static bool draw_4(int x);
-static bool draw_5(int x);
-static bool draw_6(int x);
-static bool draw_7(int x);
-static bool draw_8(int x);
-static bool draw_9(int x);
+    /// The digits.
+    int digits[2];
 
-/// Function pointer to digit drawing function.
-typedef bool (*DrawFunc)(int x);
+    /// The digits' locations in the atlas.
+    SDL_Rect src[2];
 
-/// The drawing functions for digits.
-static const DrawFunc draw_funcs[] =
-{
-    draw_0,
-    draw_1,
-    draw_2,
-    draw_3,
-    draw_4,
-    draw_5,
-    draw_6,
-    draw_7,
-    draw_8,
-    draw_9
+    /// Where the digits are drawn.
+    SDL_Rect dst[2];
 };
 
+/// The players' score caches.
+static struct ScoreCache score_caches[PLAYER_COUNT];
+
+static bool init_backend(void);
+
+static bool create_atlas(void);
+
+static void destroy_atlas(void);
+
+static bool draw_atlas(void);
+
+static bool create_framebuffer_texture(void);
+
+static bool draw_scene(const struct Scene *scene);
+
+static const struct ScoreCache *get_score_cache(size_t player, unsigned score);
+
+static SDL_Rect get_ball_rect(const struct Ball *ball);
+
+static SDL_Rect get_paddle_rect(const struct PlayerState *players, size_t player);
+
+#if HAVE_RENDER_GEOMETRY
+static void init_geometry(void);
+
+static bool draw_geometry(const struct GameState *state);
+#endif
+
+/// The backend in use.
+static enum RendererBackend backend;
+
 static SDL_Window *window;
 
-/// The SDL renderer.
+/// The SDL renderer, or NULL if the software backend is running headless.
 static SDL_Renderer *renderer;
 
-bool r_init(bool use_vsync)
+/// The surface drawn to by an offscreen SDL renderer.
+static SDL_Surface *offscreen_surface;
+
+/// Everything that does not move, or NULL if the SDL renderer does not
+/// support render targets or the software backend is in use.
+static SDL_Texture *atlas;
+
+/// Whether the atlas needs to be redrawn.
+static bool atlas_dirty;
+
+/// The software backend's framebuffer.
+static struct Framebuffer framebuffer;
+
+/// The texture the software backend's framebuffer is uploaded to, or NULL
+/// if it is running headless.
+static SDL_Texture *framebuffer_texture;
+
+#if HAVE_RENDER_GEOMETRY
+/// The point in the atlas that solid shapes are textured with, which is the
+/// middle of the block of white pixels, so that it stays white whatever
+/// filtering is used.
+static const SDL_Rect white_point =
 {
+    ATLAS_WHITE_X + ATLAS_WHITE_SIZE / 2, ATLAS_GLYPH_Y + ATLAS_WHITE_SIZE / 2,
+    0, 0
+};
+
+/// The vertices of the frame's quads. The colours are set once, and the
+/// positions and texture coordinates are rewritten every frame.
+static SDL_Vertex vertices[MAX_QUADS * 4];
+
+/// The indices of the two triangles of each quad, which never change.
+static int indices[MAX_QUADS * 6];
+#endif
+
+bool r_init(bool use_vsync, enum RendererBackend renderer_backend)
+{
+    backend = renderer_backend;
     window = SDL_CreateWindow(
         "Table Tennis",
         SDL_WINDOWPOS_UNDEFINED,
@@ -129,43 +240,221 @@ bool r_init(bool use_vsync)
         SDL_DestroyWindow(window);
         return false;
     }
+
+    if (!init_backend())
+    {
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        return false;
+    }
     
     return true;
 }
 
-bool r_draw_frame(const struct GameState *state)
+bool r_init_offscreen(enum RendererBackend renderer_backend)
 {
-    CHECK_RESULT(SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255))
-    CHECK_RESULT(SDL_RenderClear(renderer))
+    backend = renderer_backend;
+    if (backend == R_BACKEND_SOFTWARE)
+        return init_backend();
 
-    CHECK_RESULT(SDL_SetRenderDrawColor(renderer, 128, 128, 128, 255))
-    if (!draw_table())
+    offscreen_surface = SDL_CreateRGBSurfaceWithFormat(
+        0,
+        DISPLAY_WIDTH,
+        DISPLAY_HEIGHT,
+        32,
+        SDL_PIXELFORMAT_ARGB8888
+    );
+    if (!offscreen_surface)
+    {
+        u_display_sdl_error();
         return false;
+    }
 
-    CHECK_RESULT(SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255))
-    if (!draw_score(state->players[0].score, SCORE_THICKNESS))
+    renderer = SDL_CreateSoftwareRenderer(offscreen_surface);
+    if (!renderer)
+    {
+        u_display_sdl_error();
+        SDL_FreeSurface(offscreen_surface);
+        offscreen_surface = NULL;
         return false;
-    if (!draw_score(state->players[1].score, DISPLAY_WIDTH - SCORE_THICKNESS * 10))
+    }
+
+    if (!init_backend())
+    {
+        SDL_DestroyRenderer(renderer);
+        renderer = NULL;
+        SDL_FreeSurface(offscreen_surface);
+        offscreen_surface = NULL;
         return false;
+    }
 
-    SDL_Rect ball =
+    return true;
+}
+
+void r_handle_event(const SDL_Event *event)
+{
+    switch (event->type)
     {
-        coord_to_int(state->ball.x_coord),
-        coord_to_int(state->ball.y_coord) + TABLE_Y,
-        BALL_SIZE, BALL_SIZE
-    };
-    CHECK_RESULT(SDL_RenderFillRect(renderer, &ball))
+        case SDL_RENDER_DEVICE_RESET:
+            // The textures themselves have been lost, not just their contents
+            if (backend == R_BACKEND_SOFTWARE && framebuffer_texture)
+            {
+                SDL_DestroyTexture(framebuffer_texture);
+                framebuffer_texture = NULL;
+                create_framebuffer_texture();
+            }
+            else if (backend == R_BACKEND_SDL)
+            {
+                destroy_atlas();
+                create_atlas();
+            }
+            break;
+        case SDL_RENDER_TARGETS_RESET:
+            atlas_dirty = true;
+            break;
+        case SDL_WINDOWEVENT:
+            if (event->window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                atlas_dirty = true;
+            break;
+    }
+}
+
+bool r_draw_frame(const struct GameState *state)
+{
+    struct Scene scene;
+    if (backend == R_BACKEND_SOFTWARE)
+    {
+        sc_clear(&scene);
+        sc_add_frame(&scene, state);
+        fb_draw_scene(&framebuffer, &scene);
+        return true;
+    }
 
-    if (!draw_paddles(state->players))
+    if (atlas_dirty && !draw_atlas())
         return false;
 
-    SDL_RenderPresent(renderer);
+    // Clearing also covers any letterboxing around the logical screen
+    CHECK_RESULT(SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255))
+    CHECK_RESULT(SDL_RenderClear(renderer))
+
+#if HAVE_RENDER_GEOMETRY
+    if (atlas)
+        return draw_geometry(state);
+#endif
+
+    if (!atlas)
+    {
+        sc_clear(&scene);
+        sc_add_frame(&scene, state);
+        return draw_scene(&scene);
+    }
+
+    CHECK_RESULT(SDL_RenderCopy(renderer, atlas, &screen, &screen))
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        const struct ScoreCache *cache =
+            get_score_cache(i, state->players[i].score);
+        for (int digit = 0; digit < cache->digit_count; ++digit)
+        {
+            CHECK_RESULT(SDL_RenderCopy(
+                renderer,
+                atlas,
+                &cache->src[digit],
+                &cache->dst[digit]))
+        }
+    }
+
+    SDL_Rect shapes[1 + PLAYER_COUNT];
+    shapes[0] = get_ball_rect(&state->ball);
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+        shapes[1 + i] = get_paddle_rect(state->players, i);
+    CHECK_RESULT(SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255))
+    CHECK_RESULT(SDL_RenderFillRects(renderer, shapes, 1 + PLAYER_COUNT))
 
     return true;
 }
 
+/// Converts a time to the length of a statistics chart bar.
+/// \param[in]  ns  The time, in nanoseconds.
+/// \returns    The bar's length, in pixels.
+static int stats_bar_length(uint64_t ns)
+{
+    uint64_t length = (ns + STATS_NS_PER_PIXEL - 1) / STATS_NS_PER_PIXEL;
+    return length < STATS_WIDTH ? (int)length : STATS_WIDTH;
+}
+
+bool r_draw_stats(const struct FrameStats *stats)
+{
+    // Each colour is added in one run, so that SDL can fill it with one call
+    struct Scene scene;
+    sc_clear(&scene);
+    sc_add_rect(
+        &scene,
+        STATS_X + stats_bar_length(FRAME_BUDGET_NS), 0,
+        1, ST_STAGE_COUNT * STATS_ROW_HEIGHT,
+        STATS_COLOR_BUDGET);
+    for (size_t i = 0; i < ST_STAGE_COUNT; ++i)
+    {
+        sc_add_rect(
+            &scene,
+            STATS_X, (int)i * STATS_ROW_HEIGHT,
+            stats_bar_length(st_percentile(&stats->stages[i], 99.0)),
+            STATS_ROW_HEIGHT - 1,
+            STATS_COLOR_P99);
+    }
+    for (size_t i = 0; i < ST_STAGE_COUNT; ++i)
+    {
+        sc_add_rect(
+            &scene,
+            STATS_X, (int)i * STATS_ROW_HEIGHT,
+            stats_bar_length(st_percentile(&stats->stages[i], 50.0)),
+            STATS_ROW_HEIGHT - 1,
+            STATS_COLOR_P50);
+    }
+    for (size_t i = 0; i < ST_STAGE_COUNT; ++i)
+    {
+        int max_x = STATS_X + stats_bar_length(stats->stages[i].max);
+        sc_add_rect(
+            &scene,
+            max_x < STATS_X + STATS_WIDTH ? max_x : max_x - 1,
+            (int)i * STATS_ROW_HEIGHT,
+            1, STATS_ROW_HEIGHT - 1,
+            STATS_COLOR_MAX);
+    }
+
+    return draw_scene(&scene);
+}
+
+bool r_present(void)
+{
+    if (backend == R_BACKEND_SOFTWARE)
+    {
+        if (!framebuffer_texture)
+            return true;
+
+        CHECK_RESULT(SDL_UpdateTexture(
+            framebuffer_texture,
+            NULL,
+            framebuffer.pixels,
+            framebuffer.width * (int)sizeof(uint32_t)))
+        CHECK_RESULT(SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255))
+        CHECK_RESULT(SDL_RenderClear(renderer))
+        CHECK_RESULT(SDL_RenderCopy(renderer, framebuffer_texture, NULL, NULL))
+    }
+
+    SDL_RenderPresent(renderer);
+    return true;
+}
+
 void r_quit(void)
 {
+    destroy_atlas();
+    if (framebuffer_texture)
+    {
+        SDL_DestroyTexture(framebuffer_texture);
+        framebuffer_texture = NULL;
+    }
+    fb_free(&framebuffer);
     if (renderer)
     {
         SDL_DestroyRenderer(renderer);
@@ -176,230 +465,303 @@ void r_quit(void)
         SDL_DestroyWindow(window);
         window = NULL;
     }
-}
-
-/// Draws the players' paddles.
-/// \param[in]  players The players to draw.
-/// \returns    True if successful, false otherwise.
-static bool draw_paddles(const struct PlayerState *players)
-{
-    SDL_Rect paddles[PLAYER_COUNT];
-    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    if (offscreen_surface)
     {
-        paddles[i].x = player_x_coords[i];
-        paddles[i].y = players[i].y + TABLE_Y;
-        paddles[i].w = PADDLE_WIDTH;
-        paddles[i].h = PADDLE_HEIGHT;
+        SDL_FreeSurface(offscreen_surface);
+        offscreen_surface = NULL;
     }
-    CHECK_RESULT(SDL_RenderFillRects(renderer, paddles, PLAYER_COUNT))
-
-    return true;
 }
 
-/// Draws the table.
+/// Sets up the resources used by the selected backend, once the SDL
+/// renderer (if any) has been created.
 /// \returns    True if successful, false otherwise.
-static bool draw_table(void)
+static bool init_backend(void)
 {
-    CHECK_RESULT(SDL_SetRenderDrawColor(renderer, 128, 128, 128, 255))
-    CHECK_RESULT(SDL_RenderDrawRect(renderer, &table))
-    
-    for (int y = 0; y < TABLE_HEIGHT - 2; y += 16)
+    if (backend == R_BACKEND_SDL)
+        return create_atlas();
+
+    if (!fb_init(&framebuffer, DISPLAY_WIDTH, DISPLAY_HEIGHT))
     {
-        SDL_Rect line = {TABLE_WIDTH / 2 - 1, TABLE_Y + 3 + y, 2, 12};
-        CHECK_RESULT(SDL_RenderFillRect(renderer, &line))
+        u_display_error("Out of memory", "Error");
+        return false;
+    }
+    if (renderer && !create_framebuffer_texture())
+    {
+        fb_free(&framebuffer);
+        return false;
     }
-
     return true;
 }
 
-/// Draws the score at the given X coordinate.
-/// \param[in]  score   The score to draw.
-/// \param[in]  x       The X coordinate to draw at.
+/// Creates the atlas, if the renderer supports render targets. The atlas is
+/// drawn by the next r_draw_frame() call.
 /// \returns    True if successful, false otherwise.
-static bool draw_score(unsigned score, int x)
+static bool create_atlas(void)
 {
-    char buffer[3];
-    snprintf(buffer, 3, "%2u", score);
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+        score_caches[i].score = -1;
+
+    if (!SDL_RenderTargetSupported(renderer))
+        return true;
 
-    for (int i = 0; i < 2; ++i)
+    atlas = SDL_CreateTexture(
+        renderer,
+        SDL_PIXELFORMAT_ARGB8888,
+        SDL_TEXTUREACCESS_TARGET,
+        ATLAS_WIDTH,
+        ATLAS_HEIGHT
+    );
+    if (!atlas || SDL_SetTextureBlendMode(atlas, SDL_BLENDMODE_BLEND))
     {
-        char ch = buffer[i];
-        if (ch >= '0' && ch <= '9')
-        {
-            DrawFunc func = draw_funcs[ch - '0'];
-            if (!func(x))
-                return false;
-        }
-        x += SCORE_THICKNESS * 5;
+        u_display_sdl_error();
+        destroy_atlas();
+        return false;
     }
+    atlas_dirty = true;
+
+#if HAVE_RENDER_GEOMETRY
+    init_geometry();
+#endif
 
     return true;
 }
 
-/// Draws the digit 0.
-/// \param[in]  x   The X coordinate to draw at.
-/// \returns    True if successful, false otherwise.
-static bool draw_0(int x)
+/// Destroys the atlas.
+static void destroy_atlas(void)
 {
-    SDL_Rect rects[] =
+    if (atlas)
     {
-        {x, 0, SCORE_THICKNESS * 4, SCORE_THICKNESS},
-        {x + SCORE_THICKNESS * 3, SCORE_THICKNESS, SCORE_THICKNESS, SCORE_THICKNESS * 5},
-        {x, SCORE_THICKNESS, SCORE_THICKNESS, SCORE_THICKNESS * 5},
-        {x, SCORE_THICKNESS * 6, SCORE_THICKNESS * 4, SCORE_THICKNESS}
-    };
-    int count = sizeof(rects) / sizeof(rects[0]);
-    CHECK_RESULT(SDL_RenderFillRects(renderer, rects, count))
-    return true;
+        SDL_DestroyTexture(atlas);
+        atlas = NULL;
+    }
 }
 
-/// Draws the digit 1.
-/// \param[in]  x   The X coordinate to draw at.
+/// Draws the contents of the atlas.
 /// \returns    True if successful, false otherwise.
-static bool draw_1(int x)
+static bool draw_atlas(void)
 {
-    SDL_Rect rects[] =
-    {
-        {x + SCORE_THICKNESS * 3, 0, SCORE_THICKNESS, SCORE_THICKNESS * 7}
-    };
-    int count = sizeof(rects) / sizeof(rects[0]);
-    CHECK_RESULT(SDL_RenderFillRects(renderer, rects, count))
+    struct Scene scene;
+    sc_clear(&scene);
+    sc_add_table(&scene);
+    for (int i = 0; i < 10; ++i)
+        sc_add_digit(&scene, i, i * SC_GLYPH_WIDTH, ATLAS_GLYPH_Y);
+    sc_add_rect(
+        &scene,
+        ATLAS_WHITE_X, ATLAS_GLYPH_Y,
+        ATLAS_WHITE_SIZE, ATLAS_WHITE_SIZE,
+        SC_COLOR_FOREGROUND);
+
+    CHECK_RESULT(SDL_SetRenderTarget(renderer, atlas))
+    bool successful = SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0) == 0
+        && SDL_RenderClear(renderer) == 0;
+    if (!successful)
+        u_display_sdl_error();
+    successful = successful && draw_scene(&scene);
+    CHECK_RESULT(SDL_SetRenderTarget(renderer, NULL))
+    if (!successful)
+        return false;
+
+    atlas_dirty = false;
     return true;
 }
 
-/// Draws the digit 2.
-/// \param[in]  x   The X coordinate to draw at.
+/// Creates the streaming texture the software backend uploads to.
 /// \returns    True if successful, false otherwise.
-static bool draw_2(int x)
+static bool create_framebuffer_texture(void)
 {
-    SDL_Rect rects[] =
+    framebuffer_texture = SDL_CreateTexture(
+        renderer,
+        SDL_PIXELFORMAT_ARGB8888,
+        SDL_TEXTUREACCESS_STREAMING,
+        DISPLAY_WIDTH,
+        DISPLAY_HEIGHT
+    );
+    if (!framebuffer_texture)
     {
-        {x, 0, SCORE_THICKNESS * 4, SCORE_THICKNESS},
-        {x + SCORE_THICKNESS * 3, SCORE_THICKNESS, SCORE_THICKNESS, SCORE_THICKNESS * 2},
-        {x, SCORE_THICKNESS * 3, SCORE_THICKNESS * 4, SCORE_THICKNESS},
-        {x, SCORE_THICKNESS * 4, SCORE_THICKNESS, SCORE_THICKNESS * 2},
-        {x, SCORE_THICKNESS * 6, SCORE_THICKNESS * 4, SCORE_THICKNESS}
-    };
-    int count = sizeof(rects) / sizeof(rects[0]);
-    CHECK_RESULT(SDL_RenderFillRects(renderer, rects, count))
+        u_display_sdl_error();
+        return false;
+    }
     return true;
 }
 
-/// Draws the digit 3.
-/// \param[in]  x   The X coordinate to draw at.
+/// Draws every rectangle of a scene with the selected backend. With SDL,
+/// consecutive rectangles of the same colour are filled with one call.
+/// \param[in]  scene   The scene.
 /// \returns    True if successful, false otherwise.
-static bool draw_3(int x)
+static bool draw_scene(const struct Scene *scene)
 {
-    SDL_Rect rects[] =
+    if (backend == R_BACKEND_SOFTWARE)
     {
-        {x, 0, SCORE_THICKNESS * 4, SCORE_THICKNESS},
-        {x + SCORE_THICKNESS * 3, SCORE_THICKNESS, SCORE_THICKNESS, SCORE_THICKNESS * 5},
-        {x + SCORE_THICKNESS, SCORE_THICKNESS * 3, SCORE_THICKNESS * 2, SCORE_THICKNESS},
-        {x, SCORE_THICKNESS * 6, SCORE_THICKNESS * 4, SCORE_THICKNESS}
-    };
-    int count = sizeof(rects) / sizeof(rects[0]);
-    CHECK_RESULT(SDL_RenderFillRects(renderer, rects, count))
+        fb_draw_scene(&framebuffer, scene);
+        return true;
+    }
+
+    SDL_Rect rects[SC_MAX_RECTS];
+    size_t begin = 0;
+    while (begin < scene->count)
+    {
+        uint32_t color = scene->rects[begin].color;
+        size_t end = begin;
+        for (; end < scene->count && scene->rects[end].color == color; ++end)
+        {
+            rects[end - begin].x = scene->rects[end].x;
+            rects[end - begin].y = scene->rects[end].y;
+            rects[end - begin].w = scene->rects[end].w;
+            rects[end - begin].h = scene->rects[end].h;
+        }
+
+        CHECK_RESULT(SDL_SetRenderDrawColor(
+            renderer,
+            (Uint8)(color >> 16),
+            (Uint8)(color >> 8),
+            (Uint8)color,
+            (Uint8)(color >> 24)))
+        CHECK_RESULT(SDL_RenderFillRects(renderer, rects, (int)(end - begin)))
+        begin = end;
+    }
+
     return true;
 }
 
-/// Draws the digit 4.
-/// \param[in]  x   The X coordinate to draw at.
-/// \returns    True if successful, false otherwise.
-static bool draw_4(int x)
+/// Gets the digits to draw for a player's score, recalculating them if the
+/// score has changed.
+/// \param[in]  player  The index of the player.
+/// \param[in]  score   The player's score.
+/// \returns    The player's score cache.
+static const struct ScoreCache *get_score_cache(size_t player, unsigned score)
 {
-    SDL_Rect rects[] =
+    struct ScoreCache *cache = &score_caches[player];
+    if (cache->score == (int)score)
+        return cache;
+
+    int x[2];
+    cache->score = (int)score;
+    cache->digit_count = sc_layout_score(player, score, cache->digits, x);
+    for (int i = 0; i < cache->digit_count; ++i)
     {
-        {x, 0, SCORE_THICKNESS, SCORE_THICKNESS * 4},
-        {x + SCORE_THICKNESS, SCORE_THICKNESS * 3, SCORE_THICKNESS * 2, SCORE_THICKNESS},
-        {x + SCORE_THICKNESS * 3, 0, SCORE_THICKNESS, SCORE_THICKNESS * 7}
-    };
-    int count = sizeof(rects) / sizeof(rects[0]);
-    CHECK_RESULT(SDL_RenderFillRects(renderer, rects, count))
-    return true;
+        cache->src[i].x = cache->digits[i] * SC_GLYPH_WIDTH;
+        cache->src[i].y = ATLAS_GLYPH_Y;
+        cache->dst[i].x = x[i];
+        cache->dst[i].y = 0;
+        cache->src[i].w = cache->dst[i].w = SC_GLYPH_WIDTH;
+        cache->src[i].h = cache->dst[i].h = SC_GLYPH_HEIGHT;
+    }
+    return cache;
 }
 
-/// Draws the digit 5.
-/// \param[in]  x   The X coordinate to draw at.
-/// \returns    True if successful, false otherwise.
-static bool draw_5(int x)
+/// Gets the rectangle the ball is drawn in.
+/// \param[in]  ball    The ball.
+/// \returns    The rectangle.
+static SDL_Rect get_ball_rect(const struct Ball *ball)
 {
-    SDL_Rect rects[] =
+    SDL_Rect rect =
     {
-        {x, 0, SCORE_THICKNESS * 4, SCORE_THICKNESS},
-        {x, SCORE_THICKNESS, SCORE_THICKNESS, SCORE_THICKNESS * 2},
-        {x, SCORE_THICKNESS * 3, SCORE_THICKNESS * 4, SCORE_THICKNESS},
-        {x + SCORE_THICKNESS * 3, SCORE_THICKNESS * 4, SCORE_THICKNESS, SCORE_THICKNESS * 2},
-        {x, SCORE_THICKNESS * 6, SCORE_THICKNESS * 4, SCORE_THICKNESS}
+        coord_to_int(ball->x_coord),
+        coord_to_int(ball->y_coord) + TABLE_Y,
+        BALL_SIZE, BALL_SIZE
     };
-    int count = sizeof(rects) / sizeof(rects[0]);
-    CHECK_RESULT(SDL_RenderFillRects(renderer, rects, count))
-    return true;
+    return rect;
 }
 
-/// Draws the digit 6.
-/// \param[in]  x   The X coordinate to draw at.
-/// \returns    True if successful, false otherwise.
-static bool draw_6(int x)
+/// Gets the rectangle a player's paddle is drawn in.
+/// \param[in]  players The players.
+/// \param[in]  player  The index of the player.
+/// \returns    The rectangle.
+static SDL_Rect get_paddle_rect(const struct PlayerState *players, size_t player)
 {
-    SDL_Rect rects[] =
+    SDL_Rect rect =
     {
-        {x, 0, SCORE_THICKNESS, SCORE_THICKNESS * 7},
-        {x + SCORE_THICKNESS, 0, SCORE_THICKNESS * 3, SCORE_THICKNESS},
-        {x + SCORE_THICKNESS, SCORE_THICKNESS * 3, SCORE_THICKNESS * 3, SCORE_THICKNESS},
-        {x + SCORE_THICKNESS, SCORE_THICKNESS * 6, SCORE_THICKNESS * 3, SCORE_THICKNESS},
-        {x + SCORE_THICKNESS * 3, SCORE_THICKNESS * 4, SCORE_THICKNESS, SCORE_THICKNESS * 2}
+        player_x_coords[player],
+        players[player].y + TABLE_Y,
+        PADDLE_WIDTH, PADDLE_HEIGHT
     };
-    int count = sizeof(rects) / sizeof(rects[0]);
-    CHECK_RESULT(SDL_RenderFillRects(renderer, rects, count))
-    return true;
+    return rect;
 }
 
-/// Draws the digit 7.
-/// \param[in]  x   The X coordinate to draw at.
-/// \returns    True if successful, false otherwise.
-static bool draw_7(int x)
+#if HAVE_RENDER_GEOMETRY
+/// Sets up the parts of the vertex and index buffers that never change.
+static void init_geometry(void)
 {
-    SDL_Rect rects[] =
+    const SDL_Color white = {255, 255, 255, 255};
+    for (size_t i = 0; i < MAX_QUADS * 4; ++i)
+        vertices[i].color = white;
+    for (int quad = 0; quad < MAX_QUADS; ++quad)
     {
-        {x, 0, SCORE_THICKNESS * 4, SCORE_THICKNESS},
-        {x + SCORE_THICKNESS * 3, SCORE_THICKNESS, SCORE_THICKNESS, SCORE_THICKNESS * 6}
-    };
-    int count = sizeof(rects) / sizeof(rects[0]);
-    CHECK_RESULT(SDL_RenderFillRects(renderer, rects, count))
-    return true;
+        // Vertices are top left, top right, bottom left, bottom right
+        int *quad_indices = &indices[quad * 6];
+        quad_indices[0] = quad * 4;
+        quad_indices[1] = quad * 4 + 1;
+        quad_indices[2] = quad * 4 + 2;
+        quad_indices[3] = quad * 4 + 2;
+        quad_indices[4] = quad * 4 + 1;
+        quad_indices[5] = quad * 4 + 3;
+    }
 }
 
-/// Draws the digit 8.
-/// \param[in]  x   The X coordinate to draw at.
-/// \returns    True if successful, false otherwise.
-static bool draw_8(int x)
+/// Sets the position and texture coordinates of a quad.
+/// \param[in]  quad    The index of the quad.
+/// \param[in]  dst     Where the quad is drawn.
+/// \param[in]  src     The part of the atlas the quad is textured with.
+static void set_quad(int quad, const SDL_Rect *dst, const SDL_Rect *src)
 {
-    SDL_Rect rects[] =
-    {
-        {x, 0, SCORE_THICKNESS, SCORE_THICKNESS * 7},
-        {x + SCORE_THICKNESS, 0, SCORE_THICKNESS * 2, SCORE_THICKNESS},
-        {x + SCORE_THICKNESS, SCORE_THICKNESS * 3, SCORE_THICKNESS * 2, SCORE_THICKNESS},
-        {x + SCORE_THICKNESS, SCORE_THICKNESS * 6, SCORE_THICKNESS * 2, SCORE_THICKNESS},
-        {x + SCORE_THICKNESS * 3, 0, SCORE_THICKNESS, SCORE_THICKNESS * 7}
-    };
-    int count = sizeof(rects) / sizeof(rects[0]);
-    CHECK_RESULT(SDL_RenderFillRects(renderer, rects, count))
-    return true;
+    SDL_Vertex *vertex = &vertices[quad * 4];
+    float left = (float)dst->x;
+    float top = (float)dst->y;
+    float right = (float)(dst->x + dst->w);
+    float bottom = (float)(dst->y + dst->h);
+    float u0 = (float)src->x / ATLAS_WIDTH;
+    float v0 = (float)src->y / ATLAS_HEIGHT;
+    float u1 = (float)(src->x + src->w) / ATLAS_WIDTH;
+    float v1 = (float)(src->y + src->h) / ATLAS_HEIGHT;
+
+    vertex[0].position.x = left;
+    vertex[0].position.y = top;
+    vertex[0].tex_coord.x = u0;
+    vertex[0].tex_coord.y = v0;
+    vertex[1].position.x = right;
+    vertex[1].position.y = top;
+    vertex[1].tex_coord.x = u1;
+    vertex[1].tex_coord.y = v0;
+    vertex[2].position.x = left;
+    vertex[2].position.y = bottom;
+    vertex[2].tex_coord.x = u0;
+    vertex[2].tex_coord.y = v1;
+    vertex[3].position.x = right;
+    vertex[3].position.y = bottom;
+    vertex[3].tex_coord.x = u1;
+    vertex[3].tex_coord.y = v1;
 }
 
-/// Draws the digit 9.
-/// \param[in]  x   The X coordinate to draw at.
+/// Draws the frame from the atlas with a single draw call.
+/// \param[in]  state   The state to render.
 /// \returns    True if successful, false otherwise.
-static bool draw_9(int x)
+static bool draw_geometry(const struct GameState *state)
 {
-    SDL_Rect rects[] =
+    int quads = 0;
+    set_quad(quads++, &screen, &screen);
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
     {
-        {x, 0, SCORE_THICKNESS, SCORE_THICKNESS * 4},
-        {x + SCORE_THICKNESS, 0, SCORE_THICKNESS * 2, SCORE_THICKNESS},
-        {x + SCORE_THICKNESS, SCORE_THICKNESS * 3, SCORE_THICKNESS * 2, SCORE_THICKNESS},
-        {x + SCORE_THICKNESS * 3, 0, SCORE_THICKNESS, SCORE_THICKNESS * 7}
-    };
-    int count = sizeof(rects) / sizeof(rects[0]);
-    CHECK_RESULT(SDL_RenderFillRects(renderer, rects, count))
+        const struct ScoreCache *cache =
+            get_score_cache(i, state->players[i].score);
+        for (int digit = 0; digit < cache->digit_count; ++digit)
+            set_quad(quads++, &cache->dst[digit], &cache->src[digit]);
+    }
+    SDL_Rect ball = get_ball_rect(&state->ball);
+    set_quad(quads++, &ball, &white_point);
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        SDL_Rect paddle = get_paddle_rect(state->players, i);
+        set_quad(quads++, &paddle, &white_point);
+    }
+
+    CHECK_RESULT(SDL_RenderGeometry(
+        renderer,
+        atlas,
+        vertices,
+        quads * 4,
+        indices,
+        quads * 6))
+
     return true;
 }
+#endif
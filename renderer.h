@@ -23,18 +23,56 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 /// \brief Functionality exported by the renderer module.
 
 #include "game.h"
+#include "stats.h"
+#include <SDL.h>
 #include <stdbool.h>
 
+/// The ways a frame can be drawn.
+enum RendererBackend
+{
+    /// Draw with an SDL renderer, which is usually hardware accelerated.
+    R_BACKEND_SDL,
+
+    /// Fill a framebuffer in memory, and upload it to a streaming texture
+    /// once per frame.
+    R_BACKEND_SOFTWARE
+};
+
 /// Initializes the renderer.
 /// \param[in]  use_vsync   Whether V-sync should be used.
+/// \param[in]  backend     How frames are drawn.
+/// \returns True if initialization was successful, false otherwise.
+bool r_init(bool use_vsync, enum RendererBackend backend);
+
+/// Initializes the renderer without creating a window. The SDL backend draws
+/// to an offscreen surface using SDL's software renderer; the software
+/// backend only fills its framebuffer, and never uploads it.
+/// \param[in]  backend The way frames are drawn.
 /// \returns True if initialization was successful, false otherwise.
-bool r_init(bool use_vsync);
+bool r_init_offscreen(enum RendererBackend backend);
 
-/// Draws the game state to the screen.
+/// Updates the renderer's cached textures after the window is resized or the
+/// rendering device is reset.
+/// \param[in]  event   An event received from SDL.
+void r_handle_event(const SDL_Event *event);
+
+/// Draws the game state. The frame is not shown until r_present() is called.
 /// \param[in]  state   The state to render.
 /// \returns True if drawing was successful, false otherwise.
 bool r_draw_frame(const struct GameState *state);
 
+/// Draws a bar chart of the frame timing statistics between the scores. Each
+/// stage gets a row showing its median (bright), 99th percentile (dim) and
+/// maximum (red tick), at 100 microseconds per pixel; a grey tick marks the
+/// 60 Hz frame budget.
+/// \param[in]  stats   The statistics to draw.
+/// \returns True if drawing was successful, false otherwise.
+bool r_draw_stats(const struct FrameStats *stats);
+
+/// Shows the frame that has been drawn.
+/// \returns True if successful, false otherwise.
+bool r_present(void);
+
 /// Releases resources used by the renderer.
 void r_quit(void);
 
@@ -0,0 +1,520 @@
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Implementation of the replay module.
+
+#include "replay.h"
+#include "bytes.h"
+#include <stdlib.h>
+#include <string.h>
+
+/// The magic number at the start of every replay.
+static const unsigned char magic[4] = {'T', 'T', 'R', 'P'};
+
+/// The size of a replay's header, in bytes.
+#define HEADER_SIZE (4 + 1 + 1 + PLAYER_COUNT + 8)
+
+/// The size of a keyframe, in bytes.
+#define KEYFRAME_SIZE (8 + G_SNAPSHOT_SIZE)
+
+/// The most bytes a 64-bit varint can take.
+#define MAX_VARINT_SIZE 10
+
+/// Encodes a signed number so that numbers near zero are small.
+/// \param[in]  value   The number.
+/// \returns    The encoded number.
+static uint32_t zigzag_encode(int value)
+{
+    return value < 0 ? ((uint32_t)-(value + 1) << 1) | 1u : (uint32_t)value << 1;
+}
+
+/// Decodes a number encoded by zigzag_encode().
+/// \param[in]  value   The encoded number.
+/// \returns    The number.
+static int zigzag_decode(uint64_t value)
+{
+    return value & 1 ? -(int)(value >> 1) - 1 : (int)(value >> 1);
+}
+
+/// Writes bytes to a replay.
+/// \param[in,out]  writer  The writer.
+/// \param[in]      bytes   The bytes.
+/// \param[in]      size    The number of bytes.
+static void write_bytes(struct ReplayWriter *writer, const void *bytes, size_t size)
+{
+    if (writer->file)
+    {
+        fwrite(bytes, 1, size, writer->file);
+        writer->size += size;
+        return;
+    }
+
+    if (writer->size + size > writer->capacity)
+    {
+        size_t capacity = writer->capacity ? writer->capacity * 2 : 1024;
+        while (capacity < writer->size + size)
+            capacity *= 2;
+        unsigned char *buffer = realloc(writer->buffer, capacity);
+        if (!buffer)
+        {
+            writer->failed = true;
+            return;
+        }
+        writer->buffer = buffer;
+        writer->capacity = capacity;
+    }
+    memcpy(writer->buffer + writer->size, bytes, size);
+    writer->size += size;
+}
+
+/// Writes a varint.
+/// \param[in,out]  writer  The writer.
+/// \param[in]      value   The number.
+static void write_varint(struct ReplayWriter *writer, uint64_t value)
+{
+    unsigned char bytes[MAX_VARINT_SIZE];
+    size_t size = 0;
+    do
+    {
+        bytes[size] = (unsigned char)(value & 0x7F);
+        value >>= 7;
+        if (value)
+            bytes[size] |= 0x80;
+        ++size;
+    } while (value);
+    write_bytes(writer, bytes, size);
+}
+
+/// Writes a little-endian number.
+/// \param[in,out]  writer  The writer.
+/// \param[in]      value   The number.
+/// \param[in]      size    The number of bytes to write.
+static void write_le(struct ReplayWriter *writer, uint64_t value, int size)
+{
+    unsigned char bytes[8];
+    bytes_store_le(bytes, value, size);
+    write_bytes(writer, bytes, (size_t)size);
+}
+
+/// Reads a varint.
+/// \param[in,out]  reader  The reader.
+/// \param[out]     value   Receives the number.
+/// \returns    True if successful, false if the data ended or the number
+///             is too long.
+static bool read_varint(struct ReplayReader *reader, uint64_t *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < MAX_VARINT_SIZE * 7; shift += 7)
+    {
+        if (reader->position >= reader->size)
+            return false;
+        unsigned char byte = reader->data[reader->position++];
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/// Writes the run being recorded, if it is not empty.
+/// \param[in,out]  writer  The writer.
+static void flush_run(struct ReplayWriter *writer)
+{
+    if (writer->run_length == 0)
+        return;
+
+    unsigned changed = 0;
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        if (writer->run_inputs[i] != writer->previous_inputs[i])
+            changed |= 1u << i;
+    }
+    write_varint(writer, (uint64_t)writer->run_length << PLAYER_COUNT | changed);
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        if (!(changed & 1u << i))
+            continue;
+        write_varint(
+            writer,
+            zigzag_encode(writer->run_inputs[i] - writer->previous_inputs[i]));
+        writer->previous_inputs[i] = writer->run_inputs[i];
+    }
+    writer->run_length = 0;
+}
+
+/// Saves a keyframe, ending the current run so that decoding can start at
+/// the next one.
+/// \param[in,out]  writer  The writer.
+/// \param[in]      state   The state.
+/// \returns    True if successful, false if memory could not be allocated.
+static bool add_keyframe(struct ReplayWriter *writer, const struct GameState *state)
+{
+    if (writer->keyframe_count == writer->keyframe_capacity)
+    {
+        size_t capacity = writer->keyframe_capacity
+            ? writer->keyframe_capacity * 2
+            : 64;
+        struct ReplayKeyframe *keyframes =
+            realloc(writer->keyframes, capacity * sizeof(struct ReplayKeyframe));
+        if (!keyframes)
+            return false;
+        writer->keyframes = keyframes;
+        writer->keyframe_capacity = capacity;
+    }
+
+    flush_run(writer);
+    memset(writer->previous_inputs, 0, sizeof(writer->previous_inputs));
+    struct ReplayKeyframe *keyframe = &writer->keyframes[writer->keyframe_count++];
+    keyframe->offset = writer->size;
+    keyframe->state = *state;
+    return true;
+}
+
+bool rp_create(
+    struct ReplayWriter *writer,
+    const char *path,
+    uint64_t seed,
+    const enum AIDifficulty *difficulties,
+    uint32_t interval)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->interval = interval;
+    writer->file = fopen(path, "wb");
+    if (!writer->file)
+        return false;
+
+    unsigned char header[HEADER_SIZE];
+    memcpy(header, magic, sizeof(magic));
+    header[4] = RP_VERSION;
+    header[5] = PLAYER_COUNT;
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+        header[6 + i] = (unsigned char)difficulties[i];
+    bytes_store_le(header + 6 + PLAYER_COUNT, seed, 8);
+    write_bytes(writer, header, sizeof(header));
+    if (ferror(writer->file))
+    {
+        fclose(writer->file);
+        writer->file = NULL;
+        return false;
+    }
+    return true;
+}
+
+void rp_init_memory(struct ReplayWriter *writer)
+{
+    memset(writer, 0, sizeof(*writer));
+}
+
+void rp_restart(struct ReplayWriter *writer)
+{
+    unsigned char *buffer = writer->buffer;
+    size_t capacity = writer->capacity;
+    rp_init_memory(writer);
+    writer->buffer = buffer;
+    writer->capacity = capacity;
+}
+
+void rp_free(struct ReplayWriter *writer)
+{
+    free(writer->buffer);
+    writer->buffer = NULL;
+    writer->capacity = 0;
+}
+
+bool rp_record(
+    struct ReplayWriter *writer,
+    const struct GameState *state,
+    const PlayerInput *inputs)
+{
+    if (writer->interval
+        && writer->ticks % writer->interval == 0
+        && !add_keyframe(writer, state))
+    {
+        return false;
+    }
+
+    if (writer->run_length > 0
+        && (memcmp(inputs, writer->run_inputs, sizeof(writer->run_inputs)) != 0
+            || writer->run_length == UINT32_MAX))
+    {
+        flush_run(writer);
+    }
+    memcpy(writer->run_inputs, inputs, sizeof(writer->run_inputs));
+    ++writer->run_length;
+    ++writer->ticks;
+    return true;
+}
+
+bool rp_finish(struct ReplayWriter *writer, const struct GameState *final_state)
+{
+    flush_run(writer);
+    write_varint(writer, 0);
+    write_varint(writer, writer->ticks);
+    write_le(writer, rp_state_hash(final_state), 8);
+    if (!writer->file)
+        return !writer->failed;
+
+    uint64_t index_offset = writer->size;
+    write_le(writer, writer->interval, 4);
+    write_le(writer, writer->keyframe_count, 4);
+    for (size_t i = 0; i < writer->keyframe_count; ++i)
+    {
+        unsigned char keyframe[KEYFRAME_SIZE];
+        bytes_store_le(keyframe, writer->keyframes[i].offset, 8);
+        g_snapshot(&writer->keyframes[i].state, keyframe + 8);
+        write_bytes(writer, keyframe, sizeof(keyframe));
+    }
+    write_le(writer, index_offset, 8);
+
+    bool successful = !ferror(writer->file);
+    if (fclose(writer->file) != 0)
+        successful = false;
+    writer->file = NULL;
+    free(writer->keyframes);
+    writer->keyframes = NULL;
+    return successful;
+}
+
+bool rp_open(struct ReplayReader *reader, const char *path)
+{
+    memset(reader, 0, sizeof(*reader));
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    unsigned char *data = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+    bool successful = true;
+    while (successful)
+    {
+        if (size == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 4096;
+            unsigned char *grown = realloc(data, capacity);
+            if (!grown)
+            {
+                successful = false;
+                break;
+            }
+            data = grown;
+        }
+        size_t read = fread(data + size, 1, capacity - size, file);
+        size += read;
+        if (read == 0)
+        {
+            successful = !ferror(file);
+            break;
+        }
+    }
+    fclose(file);
+
+    if (!successful || !rp_open_memory(reader, data, size))
+    {
+        free(data);
+        return false;
+    }
+    reader->owned = data;
+    return true;
+}
+
+/// Finds the keyframes at the end of a replay.
+/// \param[in,out]  reader  The reader, whose header has been read.
+/// \returns    True if successful, false if the keyframes are missing or
+///             corrupt.
+static bool read_keyframes(struct ReplayReader *reader)
+{
+    if (reader->size < HEADER_SIZE + 16)
+        return false;
+    uint64_t offset = bytes_load_le(reader->data + reader->size - 8, 8);
+    if (offset < HEADER_SIZE || offset > reader->size - 16)
+        return false;
+
+    const unsigned char *index = reader->data + offset;
+    uint32_t interval = (uint32_t)bytes_load_le(index, 4);
+    uint32_t count = (uint32_t)bytes_load_le(index + 4, 4);
+    if (interval == 0 || (reader->size - 16 - offset) / KEYFRAME_SIZE < count)
+        return false;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (bytes_load_le(index + 8 + (size_t)i * KEYFRAME_SIZE, 8) >= offset)
+            return false;
+    }
+
+    reader->interval = interval;
+    reader->keyframe_count = count;
+    reader->keyframes = index + 8;
+    return true;
+}
+
+bool rp_open_memory(struct ReplayReader *reader, const void *data, size_t size)
+{
+    memset(reader, 0, sizeof(*reader));
+    const unsigned char *bytes = data;
+    if (size < HEADER_SIZE
+        || memcmp(bytes, magic, sizeof(magic)) != 0
+        || bytes[4] != RP_VERSION
+        || bytes[5] != PLAYER_COUNT)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+        reader->difficulties[i] = (enum AIDifficulty)bytes[6 + i];
+    reader->seed = bytes_load_le(bytes + 6 + PLAYER_COUNT, 8);
+    reader->data = bytes;
+    reader->size = size;
+    reader->runs_offset = HEADER_SIZE;
+    reader->position = HEADER_SIZE;
+    return read_keyframes(reader);
+}
+
+void rp_open_runs(
+    struct ReplayReader *reader,
+    uint64_t seed,
+    const enum AIDifficulty *difficulties,
+    const void *data,
+    size_t size)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->seed = seed;
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+        reader->difficulties[i] = difficulties[i];
+    reader->data = data;
+    reader->size = size;
+}
+
+bool rp_next(struct ReplayReader *reader, PlayerInput *inputs)
+{
+    while (reader->run_left == 0)
+    {
+        if (reader->complete || !reader->data)
+            return false;
+
+        uint64_t run;
+        if (!read_varint(reader, &run))
+            return false;
+        if (run == 0)
+        {
+            // The end of the runs, followed by the trailer
+            uint64_t ticks;
+            if (!read_varint(reader, &ticks)
+                || reader->size - reader->position < 8)
+            {
+                return false;
+            }
+            reader->final_hash = bytes_load_le(reader->data + reader->position, 8);
+            reader->position += 8;
+            reader->complete = ticks == reader->ticks;
+            return false;
+        }
+
+        if (reader->interval && reader->ticks % reader->interval == 0)
+            memset(reader->inputs, 0, sizeof(reader->inputs));
+        for (size_t i = 0; i < PLAYER_COUNT; ++i)
+        {
+            uint64_t delta;
+            if (!(run & 1u << i))
+                continue;
+            if (!read_varint(reader, &delta))
+                return false;
+            reader->inputs[i] =
+                (PlayerInput)(reader->inputs[i] + zigzag_decode(delta));
+        }
+        reader->run_left = run >> PLAYER_COUNT;
+    }
+
+    memcpy(inputs, reader->inputs, sizeof(reader->inputs));
+    --reader->run_left;
+    ++reader->ticks;
+    return true;
+}
+
+bool rp_seek(struct ReplayReader *reader, uint64_t tick, struct GameState *state)
+{
+    uint64_t keyframe = reader->interval ? tick / reader->interval : 0;
+    if (reader->keyframe_count == 0)
+    {
+        keyframe = 0;
+        g_init(state, reader->seed);
+        reader->position = reader->runs_offset;
+    }
+    else
+    {
+        if (keyframe >= reader->keyframe_count)
+            keyframe = reader->keyframe_count - 1;
+        const unsigned char *bytes =
+            reader->keyframes + keyframe * KEYFRAME_SIZE;
+        reader->position = (size_t)bytes_load_le(bytes, 8);
+        if (!g_restore(state, bytes + 8))
+            return false;
+    }
+    reader->ticks = keyframe * reader->interval;
+    reader->run_left = 0;
+    reader->complete = false;
+    memset(reader->inputs, 0, sizeof(reader->inputs));
+
+    PlayerInput inputs[PLAYER_COUNT];
+    while (reader->ticks < tick)
+    {
+        if (!rp_next(reader, inputs))
+            return false;
+        g_update(state, inputs, NULL);
+    }
+    return true;
+}
+
+void rp_close(struct ReplayReader *reader)
+{
+    free(reader->owned);
+    reader->owned = NULL;
+    reader->data = NULL;
+}
+
+/// Adds a number to an FNV-1a hash, one byte at a time from the lowest.
+/// \param[in]  hash    The hash so far.
+/// \param[in]  value   The number.
+/// \param[in]  size    The number of bytes of \a value to add.
+/// \returns    The new hash.
+static uint64_t hash_add(uint64_t hash, uint64_t value, int size)
+{
+    for (int i = 0; i < size; ++i)
+    {
+        hash ^= (value >> (i * 8)) & 0xFF;
+        hash *= 0x100000001B3u;
+    }
+    return hash;
+}
+
+uint64_t rp_state_hash(const struct GameState *state)
+{
+    uint64_t hash = 0xCBF29CE484222325u;
+    const struct Ball *ball = &state->ball;
+    hash = hash_add(hash, (uint16_t)ball->x_coord, 2);
+    hash = hash_add(hash, (uint16_t)ball->y_coord, 2);
+    hash = hash_add(hash, (uint16_t)ball->dir_x, 2);
+    hash = hash_add(hash, (uint16_t)ball->dir_y, 2);
+    hash = hash_add(hash, (uint16_t)ball->speed, 2);
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        hash = hash_add(hash, state->players[i].score, 1);
+        hash = hash_add(hash, state->players[i].y, 1);
+    }
+    return hash_add(hash, state->rng.state, 8);
+}
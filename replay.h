@@ -0,0 +1,276 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Functionality exported by the replay module.
+///
+/// A replay holds everything needed to play a game again exactly: the seed,
+/// the AI difficulties, and the inputs passed to every g_update() call. It
+/// also holds a keyframe of the game state every few ticks, so that playback
+/// can start anywhere without simulating the whole game up to that point.
+/// All numbers are little-endian. The layout is:
+///
+/// | Size   | Contents                                                     |
+/// |--------|--------------------------------------------------------------|
+/// | 4      | The magic number, "TTRP"                                     |
+/// | 1      | The format version, #RP_VERSION                              |
+/// | 1      | The number of players, PLAYER_COUNT                          |
+/// | 1 each | Each player's AIDifficulty                                   |
+/// | 8      | The seed passed to g_init()                                  |
+/// | varies | Runs of ticks with the same inputs, ending with a zero       |
+/// | varies | The number of ticks, as a varint                             |
+/// | 8      | rp_state_hash() of the final state                           |
+/// | 4      | The number of ticks between keyframes                        |
+/// | 4      | The number of keyframes                                      |
+/// | varies | The keyframes                                                |
+/// | 8      | The offset of the number of ticks between keyframes          |
+///
+/// A run starts with its length in ticks shifted left by PLAYER_COUNT bits,
+/// with bit \a i set if player \a i's input differs from the previous run
+/// (which is taken to be all zeros before the first run). The new input of
+/// each of those players follows, as the difference from their old input.
+/// All of these are varints: 7 bits per byte, least significant first, with
+/// the top bit set on every byte but the last. Differences are zigzag
+/// encoded, so that small negative numbers are small too.
+///
+/// Keyframe \a i is the state before tick \a i times the keyframe interval.
+/// Runs never cross a keyframe, and the first run after one is encoded as
+/// if it were the first run of the replay, so decoding can start there. A
+/// keyframe is the offset of that run (8 bytes) followed by the state, as
+/// written by g_snapshot() (#G_SNAPSHOT_SIZE bytes). Replays of any other
+/// version are rejected.
+
+#include "ai.h"
+#include "game.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/// The version of the replay format, the only one that is read or written.
+#define RP_VERSION 3
+
+/// A keyframe being recorded.
+struct ReplayKeyframe
+{
+    /// The offset of the first run after the keyframe.
+    uint64_t offset;
+
+    /// The state.
+    struct GameState state;
+};
+
+/// Records a game to a replay file, or just its runs to memory.
+struct ReplayWriter
+{
+    /// The file being written, or NULL if recording to memory.
+    FILE *file;
+
+    /// The runs recorded to memory.
+    unsigned char *buffer;
+
+    /// The number of bytes \a buffer has room for.
+    size_t capacity;
+
+    /// Whether memory could not be allocated.
+    bool failed;
+
+    /// The inputs of the run being recorded.
+    PlayerInput run_inputs[PLAYER_COUNT];
+
+    /// The inputs of the last run written.
+    PlayerInput previous_inputs[PLAYER_COUNT];
+
+    /// The number of ticks in the run being recorded.
+    uint32_t run_length;
+
+    /// The number of ticks recorded.
+    uint64_t ticks;
+
+    /// The number of bytes written.
+    uint64_t size;
+
+    /// The number of ticks between keyframes, or zero for none.
+    uint32_t interval;
+
+    /// The keyframes recorded.
+    struct ReplayKeyframe *keyframes;
+
+    /// The number of keyframes recorded.
+    size_t keyframe_count;
+
+    /// The number of keyframes \a keyframes has room for.
+    size_t keyframe_capacity;
+};
+
+/// Reads the inputs of a replay held in memory.
+struct ReplayReader
+{
+    /// The replay's seed.
+    uint64_t seed;
+
+    /// The players' difficulties.
+    enum AIDifficulty difficulties[PLAYER_COUNT];
+
+    /// The total number of ticks, once the end of the replay has been
+    /// reached.
+    uint64_t ticks;
+
+    /// The hash of the final state, once the end of the replay has been
+    /// reached.
+    uint64_t final_hash;
+
+    /// Whether the end of the replay has been reached successfully.
+    bool complete;
+
+    /// The replay's data.
+    const unsigned char *data;
+
+    /// The size of \a data, in bytes.
+    size_t size;
+
+    /// The offset of the first run.
+    size_t runs_offset;
+
+    /// The offset of the next byte to read.
+    size_t position;
+
+    /// The inputs of the current run.
+    PlayerInput inputs[PLAYER_COUNT];
+
+    /// The number of ticks left in the current run.
+    uint64_t run_left;
+
+    /// The number of ticks between keyframes, or zero if there are none.
+    uint32_t interval;
+
+    /// The number of keyframes.
+    uint32_t keyframe_count;
+
+    /// The keyframes, within \a data.
+    const unsigned char *keyframes;
+
+    /// The data to free when the reader is closed, or NULL if it belongs to
+    /// the caller.
+    unsigned char *owned;
+};
+
+/// Creates a replay file and writes its header.
+/// \param[out] writer          The writer to initialize.
+/// \param[in]  path            The file to create.
+/// \param[in]  seed            The seed passed to g_init().
+/// \param[in]  difficulties    The players' difficulties.
+/// \param[in]  interval        The number of ticks between keyframes, which
+///                             must not be zero.
+/// \returns    True if successful, false otherwise.
+bool rp_create(
+    struct ReplayWriter *writer,
+    const char *path,
+    uint64_t seed,
+    const enum AIDifficulty *difficulties,
+    uint32_t interval);
+
+/// Initializes a writer that records only the runs, the number of ticks and
+/// the final state's hash into memory, for storing in an archive.
+/// \param[out] writer  The writer to initialize.
+void rp_init_memory(struct ReplayWriter *writer);
+
+/// Starts recording another game into memory, reusing the writer's buffer.
+/// \param[in,out]  writer  The writer.
+void rp_restart(struct ReplayWriter *writer);
+
+/// Releases the memory used by a writer that records to memory.
+/// \param[in]  writer  The writer.
+void rp_free(struct ReplayWriter *writer);
+
+/// Records the inputs of one tick.
+/// \param[in,out]  writer  The writer.
+/// \param[in]      state   The state before the tick, which is saved if a
+///                         keyframe is due.
+/// \param[in]      inputs  The inputs passed to g_update().
+/// \returns    True if successful, false if memory could not be allocated.
+bool rp_record(
+    struct ReplayWriter *writer,
+    const struct GameState *state,
+    const PlayerInput *inputs);
+
+/// Writes the end of a replay and closes its file. When recording to memory,
+/// the recording is left in \a buffer, and is \a size bytes long.
+/// \param[in,out]  writer      The writer.
+/// \param[in]      final_state The state after the last recorded tick.
+/// \returns    True if the whole replay was written, false otherwise.
+bool rp_finish(struct ReplayWriter *writer, const struct GameState *final_state);
+
+/// Reads a replay file into memory and reads its header.
+/// \param[out] reader  The reader to initialize.
+/// \param[in]  path    The file to read.
+/// \returns    True if successful, false if the file could not be read or
+///             is not a replay.
+bool rp_open(struct ReplayReader *reader, const char *path);
+
+/// Reads the header of a replay held in memory, without copying it.
+/// \param[out] reader  The reader to initialize.
+/// \param[in]  data    The replay, which must outlive the reader.
+/// \param[in]  size    The size of \a data, in bytes.
+/// \returns    True if successful, false if the data is not a replay.
+bool rp_open_memory(struct ReplayReader *reader, const void *data, size_t size);
+
+/// Starts reading runs recorded to memory by a writer from
+/// rp_init_memory(), without copying them.
+/// \param[out] reader          The reader to initialize.
+/// \param[in]  seed            The game's seed.
+/// \param[in]  difficulties    The players' difficulties.
+/// \param[in]  data            The runs, which must outlive the reader.
+/// \param[in]  size            The size of \a data, in bytes.
+void rp_open_runs(
+    struct ReplayReader *reader,
+    uint64_t seed,
+    const enum AIDifficulty *difficulties,
+    const void *data,
+    size_t size);
+
+/// Reads the inputs of the next tick.
+/// \param[in,out]  reader  The reader.
+/// \param[out]     inputs  Receives the inputs to pass to g_update().
+/// \returns    True if there was another tick, false at the end of the
+///             replay or if it is corrupt; \a complete tells them apart.
+bool rp_next(struct ReplayReader *reader, PlayerInput *inputs);
+
+/// Moves to a tick, starting from the last keyframe before it. A replay
+/// without keyframes is simulated from the start.
+/// \param[in,out]  reader  The reader.
+/// \param[in]      tick    The tick to move to.
+/// \param[out]     state   Receives the state before the tick.
+/// \returns    True if successful, false if the replay ends before the tick
+///             or is corrupt.
+bool rp_seek(struct ReplayReader *reader, uint64_t tick, struct GameState *state);
+
+/// Releases the memory used by a reader.
+/// \param[in]  reader  The reader.
+void rp_close(struct ReplayReader *reader);
+
+/// Hashes every member of a game state, independently of its layout in
+/// memory, to check that a replay reproduced it exactly.
+/// \param[in]  state   The state.
+/// \returns    The hash.
+uint64_t rp_state_hash(const struct GameState *state);
+
+#endif
@@ -0,0 +1,60 @@
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Implementation of the random number generator module.
+
+#include "rng.h"
+
+/// The LCG multiplier used by PCG32.
+#define PCG_MULTIPLIER UINT64_C(6364136223846793005)
+
+/// The LCG increment used by PCG32. It must be odd.
+#define PCG_INCREMENT UINT64_C(1442695040888963407)
+
+/// Scrambles a seed with SplitMix64, so that similar seeds (e.g. consecutive
+/// integers) produce unrelated sequences.
+/// \param[in]  x   The seed.
+/// \returns    The scrambled seed.
+static uint64_t splitmix64(uint64_t x)
+{
+    x += UINT64_C(0x9E3779B97F4A7C15);
+    x = (x ^ (x >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94D049BB133111EB);
+    return x ^ (x >> 31);
+}
+
+void rng_seed(struct Rng *rng, uint64_t seed)
+{
+    rng->state = splitmix64(seed) + PCG_INCREMENT;
+    rng_next(rng);
+}
+
+uint32_t rng_next(struct Rng *rng)
+{
+    uint64_t old = rng->state;
+    rng->state = old * PCG_MULTIPLIER + PCG_INCREMENT;
+    uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+    unsigned rot = (unsigned)(old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+uint32_t rng_range(struct Rng *rng, uint32_t bound)
+{
+    return (uint32_t)(((uint64_t)rng_next(rng) * bound) >> 32);
+}
@@ -0,0 +1,52 @@
+#ifndef RNG_H
+#define RNG_H
+
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Functionality exported by the random number generator module.
+
+#include <stdint.h>
+
+/// The state of a PCG32 random number generator. Each generator is
+/// independent, so separate games never contend for shared state, and the
+/// numbers it produces depend only on its seed.
+struct Rng
+{
+    /// The generator's internal state.
+    uint64_t state;
+};
+
+/// Seeds a random number generator.
+/// \param[out] rng     The generator to seed.
+/// \param[in]  seed    The seed value.
+void rng_seed(struct Rng *rng, uint64_t seed);
+
+/// Generates a random number.
+/// \param[in]  rng The generator.
+/// \returns    A uniformly distributed 32-bit number.
+uint32_t rng_next(struct Rng *rng);
+
+/// Generates a random number less than a bound.
+/// \param[in]  rng     The generator.
+/// \param[in]  bound   The exclusive upper bound; must not be zero.
+/// \returns    A number in the range [0, \a bound).
+uint32_t rng_range(struct Rng *rng, uint32_t bound);
+
+#endif
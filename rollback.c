@@ -0,0 +1,136 @@
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Implementation of the rollback module.
+///
+/// Every ring is indexed by tick % #RB_WINDOW. Rollbacks never reach further
+/// back than #RB_MAX_PREDICTION ticks, and remote inputs are not accepted
+/// more than #RB_MAX_PREDICTION ticks ahead, so no entry needed for a
+/// rollback is overwritten. Local inputs are kept for #RB_WINDOW ticks; a
+/// caller that resends them has to stop adding new ones before an input it
+/// may still resend is overwritten.
+
+#include "rollback.h"
+#include <string.h>
+
+/// Gets the remote player's input for a tick: the confirmed input if it has
+/// arrived, otherwise a prediction that the last confirmed input is held.
+/// \param[in]  session The session.
+/// \param[in]  tick    The tick.
+/// \returns    The remote player's input.
+static PlayerInput remote_input(const struct RollbackSession *session, uint32_t tick)
+{
+    if (tick < session->remote_count)
+        return session->remote[tick % RB_WINDOW];
+    if (session->remote_count == 0)
+        return 0;
+    return session->remote[(session->remote_count - 1) % RB_WINDOW];
+}
+
+/// Simulates one tick, storing the inputs used and the resulting state.
+/// \param[in,out]  session The session.
+/// \param[in]      tick    The tick to simulate.
+/// \param[out]     events  Buffer that receives the tick's events, or NULL.
+static void simulate(struct RollbackSession *session, uint32_t tick, struct GameEvents *events)
+{
+    PlayerInput *inputs = session->used[tick % RB_WINDOW];
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        inputs[i] = i == session->local_player
+            ? session->local[tick % RB_WINDOW]
+            : remote_input(session, tick);
+    }
+
+    struct GameState state = session->states[tick % RB_WINDOW];
+    g_update(&state, inputs, events);
+    session->states[(tick + 1) % RB_WINDOW] = state;
+}
+
+void rb_init(
+    struct RollbackSession *session,
+    uint64_t seed,
+    size_t local_player,
+    unsigned input_delay)
+{
+    memset(session, 0, sizeof(*session));
+    session->local_player = local_player;
+    session->input_delay = input_delay;
+    session->local_count = input_delay;
+    session->rollback_tick = UINT32_MAX;
+    g_init(&session->states[0], seed);
+}
+
+void rb_add_local_input(struct RollbackSession *session, PlayerInput input)
+{
+    session->local[session->local_count % RB_WINDOW] = input;
+    ++session->local_count;
+}
+
+bool rb_add_remote_input(struct RollbackSession *session, uint32_t tick, PlayerInput input)
+{
+    if (tick != session->remote_count
+        || tick >= session->tick + RB_MAX_PREDICTION)
+        return false;
+
+    session->remote[tick % RB_WINDOW] = input;
+    ++session->remote_count;
+    if (tick < session->tick)
+    {
+        // This tick was simulated with a prediction
+        ++session->stats.predicted;
+        size_t remote_player = 1 - session->local_player;
+        if (session->used[tick % RB_WINDOW][remote_player] != input)
+        {
+            ++session->stats.mispredicted;
+            if (tick < session->rollback_tick)
+                session->rollback_tick = tick;
+        }
+    }
+    return true;
+}
+
+bool rb_ready(const struct RollbackSession *session)
+{
+    return session->tick < session->remote_count + RB_MAX_PREDICTION;
+}
+
+void rb_advance(struct RollbackSession *session, struct GameEvents *events)
+{
+    if (session->rollback_tick < session->tick)
+    {
+        unsigned depth = (unsigned)(session->tick - session->rollback_tick);
+        for (uint32_t tick = session->rollback_tick; tick < session->tick; ++tick)
+            simulate(session, tick, NULL);
+
+        ++session->stats.rollbacks;
+        session->stats.resimulated += depth;
+        if (depth > session->stats.max_depth)
+            session->stats.max_depth = depth;
+    }
+    session->rollback_tick = UINT32_MAX;
+
+    simulate(session, session->tick, events);
+    ++session->tick;
+    ++session->stats.ticks;
+}
+
+const struct GameState *rb_state(const struct RollbackSession *session)
+{
+    return &session->states[session->tick % RB_WINDOW];
+}
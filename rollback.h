@@ -0,0 +1,161 @@
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Functionality exported by the rollback module.
+///
+/// Two peers each simulate the whole game. The local player's input is
+/// known straight away, but the remote player's arrives some ticks late, so
+/// until it does the session predicts that the remote player is still doing
+/// what they were last known to be doing. When an input arrives that differs
+/// from the prediction, the session restores the state from before that
+/// tick and simulates forward again with the real input. This module knows
+/// nothing about the network; it only keeps the inputs and past states.
+
+#include "game.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// The number of ticks of states and inputs a session keeps.
+#define RB_WINDOW 64
+
+/// The furthest the session predicts ahead of the last confirmed remote
+/// input, in ticks. Past this, rb_ready() returns false until more inputs
+/// arrive.
+#define RB_MAX_PREDICTION (RB_WINDOW / 2)
+
+/// The highest accepted input delay, in ticks.
+#define RB_MAX_INPUT_DELAY 15
+
+/// Counters describing how a session has gone so far.
+struct RollbackStats
+{
+    /// The number of ticks simulated, not counting re-simulation.
+    uint64_t ticks;
+
+    /// The number of times the session rolled back.
+    uint64_t rollbacks;
+
+    /// The number of ticks simulated again because of a rollback.
+    uint64_t resimulated;
+
+    /// The most ticks rolled back at once.
+    unsigned max_depth;
+
+    /// The number of remote inputs that were predicted before they arrived.
+    uint64_t predicted;
+
+    /// The number of predicted remote inputs that turned out to be wrong.
+    uint64_t mispredicted;
+};
+
+/// The state of a rollback session.
+struct RollbackSession
+{
+    /// The index of the player controlled on this machine.
+    size_t local_player;
+
+    /// The number of ticks between reading a local input and using it.
+    unsigned input_delay;
+
+    /// The next tick to simulate.
+    uint32_t tick;
+
+    /// The state before each recent tick, indexed by tick % #RB_WINDOW.
+    struct GameState states[RB_WINDOW];
+
+    /// The inputs each recent tick was simulated with.
+    PlayerInput used[RB_WINDOW][PLAYER_COUNT];
+
+    /// The local player's inputs, indexed by tick % #RB_WINDOW.
+    PlayerInput local[RB_WINDOW];
+
+    /// The number of ticks the local player's input is known for.
+    uint32_t local_count;
+
+    /// The remote player's confirmed inputs, indexed by tick % #RB_WINDOW.
+    PlayerInput remote[RB_WINDOW];
+
+    /// The number of ticks the remote player's input is confirmed for.
+    uint32_t remote_count;
+
+    /// The earliest tick simulated with a wrong prediction, or UINT32_MAX.
+    uint32_t rollback_tick;
+
+    /// The counters.
+    struct RollbackStats stats;
+};
+
+/// Starts a session.
+/// \param[out] session         The session to initialize.
+/// \param[in]  seed            The seed the game starts with, which must be
+///                             the same on both peers.
+/// \param[in]  local_player    The index of the player controlled on this
+///                             machine.
+/// \param[in]  input_delay     The number of ticks between reading a local
+///                             input and using it, up to
+///                             #RB_MAX_INPUT_DELAY. The local player's
+///                             input is neutral for the first
+///                             \a input_delay ticks.
+void rb_init(
+    struct RollbackSession *session,
+    uint64_t seed,
+    size_t local_player,
+    unsigned input_delay);
+
+/// Adds the local player's input for the tick \a input_delay ticks after the
+/// next one. Call it once before each rb_advance(). Only the last
+/// #RB_WINDOW local inputs are kept.
+/// \param[in,out]  session The session.
+/// \param[in]      input   The local player's input.
+void rb_add_local_input(struct RollbackSession *session, PlayerInput input);
+
+/// Adds one of the remote player's inputs. Inputs must be added in order;
+/// ones that are already known or that leave a gap are ignored, so the
+/// caller can pass on every input it receives.
+/// \param[in,out]  session The session.
+/// \param[in]      tick    The tick the input is for.
+/// \param[in]      input   The remote player's input.
+/// \returns    True if the input was new and accepted, false otherwise.
+bool rb_add_remote_input(struct RollbackSession *session, uint32_t tick, PlayerInput input);
+
+/// Checks whether the next tick can be simulated without predicting further
+/// than #RB_MAX_PREDICTION ticks.
+/// \param[in]  session The session.
+/// \returns    True if rb_advance() can be called, false if the session has to
+///             wait for the remote player's inputs.
+bool rb_ready(const struct RollbackSession *session);
+
+/// Simulates the next tick, first rolling back and re-simulating any ticks
+/// whose prediction turned out to be wrong.
+/// \param[in,out]  session The session.
+/// \param[out]     events  Buffer that receives the events of the new tick,
+///                         or NULL. Events of re-simulated ticks are not
+///                         reported.
+void rb_advance(struct RollbackSession *session, struct GameEvents *events);
+
+/// Gets the state after the last simulated tick.
+/// \param[in]  session The session.
+/// \returns    The current state.
+const struct GameState *rb_state(const struct RollbackSession *session);
+
+#endif
@@ -0,0 +1,185 @@
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Implementation of the scene module.
+
+#include "scene.h"
+#include "constants.h"
+#include "coord.h"
+
+/// The distance between the left edges of a score's digits, in pixels.
+#define GLYPH_ADVANCE (SC_SCORE_THICKNESS * 5)
+
+/// The most rectangles a score digit is made of.
+#define MAX_GLYPH_RECTS 5
+
+/// A rectangle in units of SC_SCORE_THICKNESS.
+struct GlyphRect
+{
+    /// The X coordinate of the left edge.
+    signed char x;
+
+    /// The Y coordinate of the top edge.
+    signed char y;
+
+    /// The width.
+    signed char w;
+
+    /// The height.
+    signed char h;
+};
+
+/// The shape of a score digit.
+struct Glyph
+{
+    /// The number of rectangles in \a rects.
+    int count;
+
+    /// The rectangles that make up the digit.
+    struct GlyphRect rects[MAX_GLYPH_RECTS];
+};
+
+/// The shapes of the digits 0 to 9.
+static const struct Glyph glyphs[10] =
+{
+    {4, {{0, 0, 4, 1}, {3, 1, 1, 5}, {0, 1, 1, 5}, {0, 6, 4, 1}}},
+    {1, {{3, 0, 1, 7}}},
+    {5, {{0, 0, 4, 1}, {3, 1, 1, 2}, {0, 3, 4, 1}, {0, 4, 1, 2}, {0, 6, 4, 1}}},
+    {4, {{0, 0, 4, 1}, {3, 1, 1, 5}, {1, 3, 2, 1}, {0, 6, 4, 1}}},
+    {3, {{0, 0, 1, 4}, {1, 3, 2, 1}, {3, 0, 1, 7}}},
+    {5, {{0, 0, 4, 1}, {0, 1, 1, 2}, {0, 3, 4, 1}, {3, 4, 1, 2}, {0, 6, 4, 1}}},
+    {5, {{0, 0, 1, 7}, {1, 0, 3, 1}, {1, 3, 3, 1}, {1, 6, 3, 1}, {3, 4, 1, 2}}},
+    {2, {{0, 0, 4, 1}, {3, 1, 1, 6}}},
+    {5, {{0, 0, 1, 7}, {1, 0, 2, 1}, {1, 3, 2, 1}, {1, 6, 2, 1}, {3, 0, 1, 7}}},
+    {4, {{0, 0, 1, 4}, {1, 0, 2, 1}, {1, 3, 2, 1}, {3, 0, 1, 7}}}
+};
+
+/// The X coordinates of the players' scores.
+static const int score_x_coords[PLAYER_COUNT] =
+{
+    SC_SCORE_THICKNESS,
+    DISPLAY_WIDTH - SC_SCORE_THICKNESS * 10
+};
+
+void sc_clear(struct Scene *scene)
+{
+    scene->count = 0;
+}
+
+void sc_add_rect(struct Scene *scene, int x, int y, int w, int h, uint32_t color)
+{
+    if (scene->count >= SC_MAX_RECTS)
+        return;
+
+    struct SceneRect *rect = &scene->rects[scene->count++];
+    rect->x = x;
+    rect->y = y;
+    rect->w = w;
+    rect->h = h;
+    rect->color = color;
+}
+
+void sc_add_table(struct Scene *scene)
+{
+    sc_add_rect(scene, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, SC_COLOR_BACKGROUND);
+
+    // The outline is one pixel wide
+    sc_add_rect(scene, 0, TABLE_Y, TABLE_WIDTH, 1, SC_COLOR_TABLE);
+    sc_add_rect(
+        scene,
+        0, TABLE_Y + TABLE_HEIGHT - 1,
+        TABLE_WIDTH, 1,
+        SC_COLOR_TABLE);
+    sc_add_rect(scene, 0, TABLE_Y + 1, 1, TABLE_HEIGHT - 2, SC_COLOR_TABLE);
+    sc_add_rect(
+        scene,
+        TABLE_WIDTH - 1, TABLE_Y + 1,
+        1, TABLE_HEIGHT - 2,
+        SC_COLOR_TABLE);
+
+    for (int y = 0; y < TABLE_HEIGHT - 2; y += 16)
+    {
+        sc_add_rect(
+            scene,
+            TABLE_WIDTH / 2 - 1, TABLE_Y + 3 + y,
+            2, 12,
+            SC_COLOR_TABLE);
+    }
+}
+
+void sc_add_digit(struct Scene *scene, int digit, int x, int y)
+{
+    const struct Glyph *glyph = &glyphs[digit];
+    for (int i = 0; i < glyph->count; ++i)
+    {
+        const struct GlyphRect *rect = &glyph->rects[i];
+        sc_add_rect(
+            scene,
+            x + rect->x * SC_SCORE_THICKNESS,
+            y + rect->y * SC_SCORE_THICKNESS,
+            rect->w * SC_SCORE_THICKNESS,
+            rect->h * SC_SCORE_THICKNESS,
+            SC_COLOR_FOREGROUND);
+    }
+}
+
+int sc_layout_score(size_t player, unsigned score, int digits[2], int x[2])
+{
+    int count = 0;
+    if (score >= 10)
+        digits[count++] = (int)(score / 10 % 10);
+    digits[count++] = (int)(score % 10);
+    for (int i = 0; i < count; ++i)
+    {
+        int column = count == 2 ? i : 1;
+        x[i] = score_x_coords[player] + column * GLYPH_ADVANCE;
+    }
+    return count;
+}
+
+void sc_add_frame(struct Scene *scene, const struct GameState *state)
+{
+    sc_add_table(scene);
+
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        int digits[2];
+        int x[2];
+        int count = sc_layout_score(i, state->players[i].score, digits, x);
+        for (int digit = 0; digit < count; ++digit)
+            sc_add_digit(scene, digits[digit], x[digit], 0);
+    }
+
+    sc_add_rect(
+        scene,
+        coord_to_int(state->ball.x_coord),
+        coord_to_int(state->ball.y_coord) + TABLE_Y,
+        BALL_SIZE, BALL_SIZE,
+        SC_COLOR_FOREGROUND);
+
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        sc_add_rect(
+            scene,
+            player_x_coords[i],
+            state->players[i].y + TABLE_Y,
+            PADDLE_WIDTH, PADDLE_HEIGHT,
+            SC_COLOR_FOREGROUND);
+    }
+}
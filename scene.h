@@ -0,0 +1,122 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Functionality exported by the scene module.
+///
+/// Everything the game draws is a solid, axis-aligned rectangle. This module
+/// describes a frame as a list of such rectangles, without depending on SDL,
+/// so that the same frame can be drawn by SDL or rasterized in memory.
+
+#include "game.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// The most rectangles a scene can hold.
+#define SC_MAX_RECTS 96
+
+/// The thickness of the score numbers, in pixels.
+#define SC_SCORE_THICKNESS 3
+
+/// The width of a score digit, in pixels.
+#define SC_GLYPH_WIDTH (SC_SCORE_THICKNESS * 4)
+
+/// The height of a score digit, in pixels.
+#define SC_GLYPH_HEIGHT (SC_SCORE_THICKNESS * 7)
+
+/// The colour of the background, as 0xAARRGGBB.
+#define SC_COLOR_BACKGROUND 0xFF000000u
+
+/// The colour of the table, as 0xAARRGGBB.
+#define SC_COLOR_TABLE 0xFF808080u
+
+/// The colour of the ball, paddles and scores, as 0xAARRGGBB.
+#define SC_COLOR_FOREGROUND 0xFFFFFFFFu
+
+/// A solid rectangle.
+struct SceneRect
+{
+    /// The X coordinate of the left edge.
+    int x;
+
+    /// The Y coordinate of the top edge.
+    int y;
+
+    /// The width.
+    int w;
+
+    /// The height.
+    int h;
+
+    /// The colour, as 0xAARRGGBB.
+    uint32_t color;
+};
+
+/// A list of rectangles, drawn in order.
+struct Scene
+{
+    /// The number of rectangles.
+    size_t count;
+
+    /// The rectangles.
+    struct SceneRect rects[SC_MAX_RECTS];
+};
+
+/// Empties a scene.
+/// \param[out] scene   The scene.
+void sc_clear(struct Scene *scene);
+
+/// Adds a rectangle to a scene. Rectangles past #SC_MAX_RECTS are dropped.
+/// \param[in,out]  scene   The scene.
+/// \param[in]      x       The X coordinate of the left edge.
+/// \param[in]      y       The Y coordinate of the top edge.
+/// \param[in]      w       The width.
+/// \param[in]      h       The height.
+/// \param[in]      color   The colour, as 0xAARRGGBB.
+void sc_add_rect(struct Scene *scene, int x, int y, int w, int h, uint32_t color);
+
+/// Adds the background and table to a scene.
+/// \param[in,out]  scene   The scene.
+void sc_add_table(struct Scene *scene);
+
+/// Adds a score digit to a scene.
+/// \param[in,out]  scene   The scene.
+/// \param[in]      digit   The digit, from 0 to 9.
+/// \param[in]      x       The X coordinate of the digit's left edge.
+/// \param[in]      y       The Y coordinate of the digit's top edge.
+void sc_add_digit(struct Scene *scene, int digit, int x, int y);
+
+/// Works out which digits to draw for a player's score, and where. Scores
+/// are right-aligned in two columns, without a leading zero.
+/// \param[in]  player  The index of the player.
+/// \param[in]  score   The player's score.
+/// \param[out] digits  Receives the digits.
+/// \param[out] x       Receives the X coordinate of each digit.
+/// \returns    The number of digits.
+int sc_layout_score(size_t player, unsigned score, int digits[2], int x[2]);
+
+/// Adds a complete frame to a scene: the background, the table, the scores,
+/// the ball and the paddles.
+/// \param[in,out]  scene   The scene.
+/// \param[in]      state   The game state to draw.
+void sc_add_frame(struct Scene *scene, const struct GameState *state);
+
+#endif
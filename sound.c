@@ -20,41 +20,109 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 /// \brief Implementation of the sound module.
 
 #include "sound.h"
+#include "assets.h"
+#include "stats.h"
 #include "util.h"
 #include <SDL.h>
 #include <SDL_mixer.h>
-#include <errno.h>
 #include <stddef.h>
-#include <stdlib.h>
 #include <string.h>
 
+/// The number of mixer callbacks after the audio device opens whose timing
+/// is ignored, while the device starts up.
+#define WARMUP_CALLBACKS 4
+
+/// A callback that comes this many buffer periods after the one before it
+/// is counted as an underrun: the device must have run out of audio.
+#define UNDERRUN_PERIODS 2
+
+/// The length of the window underruns are counted over, in milliseconds.
+#define UNDERRUN_WINDOW 2000
+
+/// The number of underruns in one window that makes the module reopen the
+/// device with a larger buffer.
+#define UNDERRUN_LIMIT 3
+
+/// The states the sound system can be in.
+enum SoundState
+{
+    /// Not started, failed or shut down. Sounds are not played.
+    STATE_OFF,
+
+    /// Opening the device on the background thread. Sounds are not played.
+    STATE_STARTING,
+
+    /// Ready to play sounds.
+    STATE_READY
+};
+
+/// The current SoundState. The background thread only sets it once it has
+/// finished with everything else, so the main thread can then use the rest
+/// of the module's variables.
+static SDL_atomic_t state;
+
+/// The thread starting the sound system, or NULL once it has been waited
+/// for.
+static SDL_Thread *start_thread = NULL;
+
+/// The buffer size the background thread opens the device with.
+static int start_size = 0;
+
+/// Whether the background thread logs how long each step took.
+static bool trace_start = false;
+
 /// Sample for the bounce sound effect.
 static Mix_Chunk *bounce_sample = NULL;
 
 /// Sample for the score sound effect.
 static Mix_Chunk *score_sample = NULL;
 
-/// Returns the concatenation of two strings.
-/// \param[in]  a   The first string.
-/// \param[in]  b   The second string.
-/// \returns    The concatenated string.
-static char *concat(const char *a, const char *b)
-{
-    size_t a_len = strlen(a);
-    size_t b_len = strlen(b) + 1;
-    char *buffer = malloc(a_len + b_len);
-    if (buffer)
-    {
-        memcpy(buffer, a, a_len);
-        memcpy(buffer + a_len, b, b_len);
-    }
-    return buffer;
-}
+/// The audio buffer size the device was opened with, in sample frames, or
+/// zero if it is not open.
+static int buffer_size = 0;
+
+/// The device's sample rate.
+static int frequency = 0;
+
+/// The device's sample format.
+static Uint16 format = 0;
+
+/// The device's number of channels.
+static int channels = 0;
+
+/// The number of callbacks since the device was opened. Only used by the
+/// audio thread.
+static int callback_count = 0;
+
+/// The performance counter value at the last callback. Only used by the
+/// audio thread.
+static Uint64 last_callback = 0;
+
+/// The sample frames filled by each callback. Written by the audio thread;
+/// only read once the post-mix hook has been removed.
+static int callback_frames = 0;
+
+/// The time between callbacks. Written by the audio thread; only read once
+/// the post-mix hook has been removed.
+static struct Histogram callback_periods;
+
+/// The number of underruns since s_update() last checked.
+static SDL_atomic_t recent_underruns;
+
+/// The number of underruns since the device was first opened.
+static unsigned long total_underruns = 0;
+
+/// The SDL_GetTicks() value when the current underrun window started.
+static Uint32 window_start = 0;
 
 /// Plays a sound sample.
 /// \param[in]  sample  The sample to play.
 static void play_sample(Mix_Chunk *sample)
 {
+    // Sounds are dropped until the sound system has started
+    if (SDL_AtomicGet(&state) != STATE_READY)
+        return;
+
     int channel = Mix_PlayChannel(-1, sample, 0);
     if (channel == -1)
     {
@@ -65,61 +133,257 @@ static void play_sample(Mix_Chunk *sample)
     }
 }
 
-bool s_init(void)
+/// Measures the time between mixer callbacks. Runs on the audio thread,
+/// after each buffer has been mixed.
+/// \param[in]  udata   Unused.
+/// \param[in]  stream  Unused.
+/// \param[in]  len     The size of the buffer, in bytes.
+static void SDLCALL measure_callback(void *udata, Uint8 *stream, int len)
 {
-    if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 1, 1024))
+    (void)udata;
+    (void)stream;
+    Uint64 now = SDL_GetPerformanceCounter();
+    callback_frames = len / (SDL_AUDIO_BITSIZE(format) / 8 * channels);
+    if (++callback_count > WARMUP_CALLBACKS)
     {
-        u_display_error(Mix_GetError(), "SDL Mixer Error");
-        return false;
+        double ns = (double)(now - last_callback) * 1e9
+            / SDL_GetPerformanceFrequency();
+        st_add(&callback_periods, (uint64_t)ns);
+        if (ns > callback_frames * 1e9 / frequency * UNDERRUN_PERIODS)
+            SDL_AtomicAdd(&recent_underruns, 1);
     }
+    last_callback = now;
+}
 
-    char *base_path = SDL_GetBasePath();
-    char *path = NULL;
-    if (!base_path)
+/// Loads a sound effect compiled into the executable. It is converted to
+/// the device's format.
+/// \param[in]  data    The contents of the WAV file.
+/// \param[in]  size    The size of \a data, in bytes.
+/// \returns    The sample, or NULL on failure.
+static Mix_Chunk *load_sample(const unsigned char *data, size_t size)
+{
+    Mix_Chunk *sample = Mix_LoadWAV_RW(SDL_RWFromConstMem(data, (int)size), 1);
+    if (!sample)
     {
-        u_display_sdl_error();
-        goto error;
+        SDL_LogError(
+            SDL_LOG_CATEGORY_APPLICATION,
+            "Failed to load a sound: %s",
+            Mix_GetError());
     }
+    return sample;
+}
+
+/// Loads the sound effects.
+/// \returns True if successful, false otherwise.
+static bool load_samples(void)
+{
+    bounce_sample = load_sample(as_bounce_wav, as_bounce_wav_size);
+    score_sample = load_sample(as_score_wav, as_score_wav_size);
+    return bounce_sample && score_sample;
+}
 
-    path = concat(base_path, "sounds/bounce.wav");
-    if (!path)
+/// Opens the audio device and starts measuring its callbacks.
+/// \param[in]  size    The audio buffer size, in sample frames.
+/// \returns True if successful, false otherwise.
+static bool open_device(int size)
+{
+    if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 1, size))
     {
-        u_display_error(strerror(errno), "Error");
-        goto error;
+        SDL_LogError(
+            SDL_LOG_CATEGORY_APPLICATION,
+            "Failed to open the audio device: %s",
+            Mix_GetError());
+        return false;
     }
-    bounce_sample = Mix_LoadWAV(path);
-    if (!bounce_sample)
+    buffer_size = size;
+    Mix_QuerySpec(&frequency, &format, &channels);
+
+    callback_count = 0;
+    callback_frames = 0;
+    memset(&callback_periods, 0, sizeof(callback_periods));
+    SDL_AtomicSet(&recent_underruns, 0);
+    window_start = SDL_GetTicks();
+    Mix_SetPostMix(measure_callback, NULL);
+    return true;
+}
+
+/// Frees the sound effects and closes the audio device.
+static void close_device(void)
+{
+    if (bounce_sample)
     {
-        u_display_error(Mix_GetError(), "SDL Mixer Error");
-        goto error;
+        Mix_FreeChunk(bounce_sample);
+        bounce_sample = NULL;
     }
-    free(path);
+    if (score_sample)
+    {
+        Mix_FreeChunk(score_sample);
+        score_sample = NULL;
+    }
+    if (buffer_size != 0)
+    {
+        Mix_SetPostMix(NULL, NULL);
+        Mix_CloseAudio();
+        buffer_size = 0;
+    }
+}
 
-    path = concat(base_path, "sounds/score.wav");
-    if (!path)
+/// Gets the time since a performance counter value.
+/// \param[in]  start   The performance counter value.
+/// \returns    The time since, in milliseconds.
+static double ms_since(Uint64 start)
+{
+    return (double)(SDL_GetPerformanceCounter() - start) * 1000.0
+        / SDL_GetPerformanceFrequency();
+}
+
+/// Opens the audio device, first closing it if it is open, and loads the
+/// sound effects. Runs on the background thread.
+/// \param[in]  data    Unused.
+/// \returns    Zero.
+static int SDLCALL start_sound(void *data)
+{
+    (void)data;
+    close_device();
+    Uint64 start = SDL_GetPerformanceCounter();
+    bool successful = open_device(start_size);
+    double device_ms = ms_since(start);
+
+    Uint64 step_start = SDL_GetPerformanceCounter();
+    successful = successful && load_samples();
+    double samples_ms = ms_since(step_start);
+
+    if (trace_start)
     {
-        u_display_error(strerror(errno), "Error");
-        goto error;
+        SDL_Log(
+            "Startup: audio device %.2f ms, sounds %.2f ms, %.2f ms in total "
+            "on a background thread",
+            device_ms,
+            samples_ms,
+            ms_since(start));
     }
-    score_sample = Mix_LoadWAV(path);
-    if (!bounce_sample)
+    if (!successful)
+        close_device();
+    SDL_AtomicSet(&state, successful ? STATE_READY : STATE_OFF);
+    return 0;
+}
+
+/// Starts the background thread that opens the audio device. Sounds are
+/// not played until it has finished.
+/// \param[in]  size    The audio buffer size, in sample frames.
+/// \returns True if the thread was started, false otherwise.
+static bool start_device(int size)
+{
+    start_size = size;
+    SDL_AtomicSet(&state, STATE_STARTING);
+    start_thread = SDL_CreateThread(start_sound, "sound", NULL);
+    if (!start_thread)
+    {
+        SDL_AtomicSet(&state, STATE_OFF);
+        return false;
+    }
+    return true;
+}
+
+bool s_init(int size, bool trace)
+{
+    trace_start = trace;
+
+    // SDL's subsystems are not safe to initialize from another thread while
+    // the main thread creates the window, so only the device is opened in
+    // the background
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0)
     {
-        u_display_error(Mix_GetError(), "SDL Mixer Error");
-        goto error;
+        SDL_LogError(
+            SDL_LOG_CATEGORY_APPLICATION,
+            "Failed to initialize audio: %s",
+            SDL_GetError());
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Sound is disabled");
+        return true;
     }
-    free(path);
 
-    SDL_free(base_path);
+    if (!start_device(size))
+    {
+        u_display_sdl_error();
+        return false;
+    }
     return true;
+}
 
-    error:
-    free(path);
-    if (base_path)
+void s_update(void)
+{
+    int current = SDL_AtomicGet(&state);
+    if (start_thread && current != STATE_STARTING)
     {
-        SDL_free(base_path);
+        SDL_WaitThread(start_thread, NULL);
+        start_thread = NULL;
+        if (current != STATE_READY)
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Sound is disabled");
+    }
+    if (current != STATE_READY
+        || SDL_GetTicks() - window_start < UNDERRUN_WINDOW)
+        return;
+
+    window_start = SDL_GetTicks();
+    int underruns = SDL_AtomicSet(&recent_underruns, 0);
+    total_underruns += (unsigned long)underruns;
+    if (underruns < UNDERRUN_LIMIT || buffer_size >= S_MAX_BUFFER)
+        return;
+
+    int size = buffer_size * 2;
+    SDL_LogWarn(
+        SDL_LOG_CATEGORY_APPLICATION,
+        "Audio ran dry %d times in %d ms; reopening with a %d-frame buffer",
+        underruns,
+        UNDERRUN_WINDOW,
+        size);
+
+    // Reopening the device takes as long as opening it did at startup, so
+    // it happens in the background too
+    trace_start = false;
+    if (!start_device(size))
+    {
+        SDL_LogWarn(
+            SDL_LOG_CATEGORY_APPLICATION,
+            "Failed to start the sound thread: %s",
+            SDL_GetError());
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Sound is disabled");
+        close_device();
     }
-    s_quit();
-    return false;
+}
+
+void s_report(void)
+{
+    if (SDL_AtomicGet(&state) != STATE_READY)
+        return;
+
+    // SDL_LockAudio() only locks the legacy device, not the mixer's, so stop
+    // the measurements instead; once this returns, the hook is not running
+    Mix_SetPostMix(NULL, NULL);
+    int frames = callback_frames;
+    struct Histogram periods = callback_periods;
+
+    // A sound waits up to one period to be mixed, then plays after the
+    // buffer ahead of it, so it is heard one to two periods after it starts.
+    // That only counts the mixer's buffer; the device and driver usually
+    // hold more audio than that, which cannot be measured here.
+    double period = st_percentile(&periods, 50.0) / 1e6;
+    SDL_Log(
+        "Audio: %d-frame buffer, %d frames per callback at %d Hz, "
+        "callback period p50 %.2f ms, p99 %.2f ms, max %.2f ms, "
+        "%lu underruns",
+        buffer_size,
+        frames,
+        frequency,
+        period,
+        st_percentile(&periods, 99.0) / 1e6,
+        periods.max / 1e6,
+        total_underruns + (unsigned long)SDL_AtomicGet(&recent_underruns));
+    SDL_Log(
+        "Audio output latency estimated from the callback period: %.1f to "
+        "%.1f ms, not counting device or driver buffering",
+        period,
+        period * 2.0);
 }
 
 void s_play_bounce(void)
@@ -134,15 +398,14 @@ void s_play_score(void)
 
 void s_quit(void)
 {
-    if (bounce_sample)
-    {
-        Mix_FreeChunk(bounce_sample);
-        bounce_sample = NULL;
-    }
-    if (score_sample)
+    // The thread cannot be interrupted, so let it finish
+    if (start_thread)
     {
-        Mix_FreeChunk(score_sample);
-        score_sample = NULL;
+        SDL_WaitThread(start_thread, NULL);
+        start_thread = NULL;
     }
-    Mix_CloseAudio();
+    SDL_AtomicSet(&state, STATE_OFF);
+    close_device();
+    if (SDL_WasInit(SDL_INIT_AUDIO))
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
 }
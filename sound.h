@@ -21,12 +21,49 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 /// \file
 /// \brief Functionality exported by the sound module.
+///
+/// A sound starts playing the next time the mixer fills the audio device's
+/// buffer, and is heard once the buffer before it has played, so the buffer
+/// size sets how far the sound lags the event. Small buffers can run dry if
+/// the mixer is not called back in time, so the module watches how often
+/// that happens and moves to a larger buffer if it needs to.
 
 #include <stdbool.h>
 
-/// Initializes the sound system.
-/// \returns True if initialization was successful, false otherwise.
-bool s_init(void);
+/// The audio buffer size used by default, in sample frames.
+#define S_DEFAULT_BUFFER 1024
+
+/// The audio buffer size used by the low-latency preset, in sample frames.
+#define S_LOW_LATENCY_BUFFER 256
+
+/// The smallest accepted audio buffer size, in sample frames.
+#define S_MIN_BUFFER 64
+
+/// The largest audio buffer size, in sample frames, including after
+/// falling back because of underruns.
+#define S_MAX_BUFFER 4096
+
+/// Initializes the audio subsystem, then opens the audio device on a
+/// background thread, as that can take a long time. Sounds played before it
+/// is ready are dropped, and if it fails, the game carries on without sound.
+/// \param[in]  size    The audio buffer size, in sample frames: a power of two
+///                     from #S_MIN_BUFFER to #S_MAX_BUFFER.
+/// \param[in]  trace   Whether to log how long each step took.
+/// \returns False if the background thread could not be started, true
+///          otherwise.
+bool s_init(int size, bool trace);
+
+/// Finishes with the background thread once the sound system has started,
+/// then checks how often the audio buffer has run dry, and reopens the audio
+/// device on the background thread with a buffer twice the size if it
+/// happens too often. Call it once per frame.
+void s_update(void);
+
+/// Logs the audio buffer size, the measured time between mixer callbacks,
+/// the number of underruns, and an estimate of the output latency from the
+/// callback period. This stops the measurements, so call it once sound is no
+/// longer needed.
+void s_report(void);
 
 /// Plays a bounce sound effect.
 void s_play_bounce(void);
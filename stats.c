@@ -0,0 +1,160 @@
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Implementation of the frame statistics module.
+///
+/// The histograms use a log-linear layout: times below #ST_SUB_BUCKETS
+/// nanoseconds get a bucket each, and every power of two above that is split
+/// into #ST_SUB_BUCKETS equal buckets. This keeps the relative error
+/// constant while using a fixed amount of memory.
+
+#include "stats.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/// The number of bits needed to index a sub-bucket.
+#define SUB_BUCKET_BITS 4
+
+/// The names of the stages.
+static const char * const stage_names[ST_STAGE_COUNT] =
+{
+    "events",
+    "input",
+    "ai",
+    "update",
+    "draw",
+    "present",
+    "wait",
+    "frame"
+};
+
+/// Finds the position of the highest set bit of a non-zero number.
+/// \param[in]  value   The number.
+/// \returns    The bit's position.
+static int highest_bit(uint64_t value)
+{
+    int bit = 0;
+    while (value >>= 1)
+        ++bit;
+    return bit;
+}
+
+/// Finds the bucket that a time belongs in.
+/// \param[in]  ns  The time, in nanoseconds.
+/// \returns    The index of the bucket.
+static size_t bucket_index(uint64_t ns)
+{
+    if (ns < ST_SUB_BUCKETS)
+        return (size_t)ns;
+
+    int shift = highest_bit(ns) - SUB_BUCKET_BITS;
+    size_t index = (size_t)(shift + 1) * ST_SUB_BUCKETS
+        + (size_t)((ns >> shift) & (ST_SUB_BUCKETS - 1));
+    return index < ST_BUCKET_COUNT ? index : ST_BUCKET_COUNT - 1;
+}
+
+/// Finds the smallest time that belongs in a bucket.
+/// \param[in]  index   The index of the bucket.
+/// \returns    The time, in nanoseconds.
+static uint64_t bucket_lower(size_t index)
+{
+    if (index < ST_SUB_BUCKETS)
+        return index;
+
+    int shift = (int)(index / ST_SUB_BUCKETS) - 1;
+    return (uint64_t)(ST_SUB_BUCKETS + index % ST_SUB_BUCKETS) << shift;
+}
+
+void st_init(struct FrameStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void st_add(struct Histogram *histogram, uint64_t ns)
+{
+    ++histogram->counts[bucket_index(ns)];
+    ++histogram->total;
+    if (ns > histogram->max)
+        histogram->max = ns;
+}
+
+void st_record(struct FrameStats *stats, enum FrameStage stage, uint64_t ns)
+{
+    st_add(&stats->stages[stage], ns);
+}
+
+uint64_t st_percentile(const struct Histogram *histogram, double percent)
+{
+    if (histogram->total == 0)
+        return 0;
+
+    double exact_rank = histogram->total * percent / 100.0;
+    uint64_t rank = (uint64_t)exact_rank;
+    if (rank < exact_rank || rank == 0)
+        ++rank;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < ST_BUCKET_COUNT; ++i)
+    {
+        seen += histogram->counts[i];
+        if (seen >= rank)
+        {
+            // Report the top of the bucket, but never more than was recorded
+            uint64_t upper = i + 1 < ST_BUCKET_COUNT
+                ? bucket_lower(i + 1) - 1
+                : histogram->max;
+            return upper < histogram->max ? upper : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+const char *st_stage_name(enum FrameStage stage)
+{
+    return stage_names[stage];
+}
+
+bool st_write_csv(const struct FrameStats *stats, const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "stage,lower_ns,upper_ns,count\n");
+    for (size_t s = 0; s < ST_STAGE_COUNT; ++s)
+    {
+        const struct Histogram *histogram = &stats->stages[s];
+        for (size_t i = 0; i < ST_BUCKET_COUNT; ++i)
+        {
+            if (histogram->counts[i] == 0)
+                continue;
+            uint64_t upper = i + 1 < ST_BUCKET_COUNT
+                ? bucket_lower(i + 1) - 1
+                : histogram->max;
+            fprintf(file, "%s,%llu,%llu,%lu\n",
+                stage_names[s],
+                (unsigned long long)bucket_lower(i),
+                (unsigned long long)upper,
+                (unsigned long)histogram->counts[i]);
+        }
+    }
+
+    bool successful = !ferror(file);
+    return fclose(file) == 0 && successful;
+}
@@ -0,0 +1,122 @@
+#ifndef STATS_H
+#define STATS_H
+
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Functionality exported by the frame statistics module.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// The number of sub-buckets each power of two is split into. Recorded
+/// times are rounded to within 1/16 (about 6%) of their true value.
+#define ST_SUB_BUCKETS 16
+
+/// The number of buckets in a histogram, which covers times up to about 34
+/// seconds. Longer times are counted in the last bucket.
+#define ST_BUCKET_COUNT (ST_SUB_BUCKETS * 32)
+
+/// The stages of a frame that are timed.
+enum FrameStage
+{
+    /// Polling and handling SDL events.
+    ST_STAGE_EVENTS,
+
+    /// Reading the keyboard and controllers.
+    ST_STAGE_INPUT,
+
+    /// Determining the AI players' inputs.
+    ST_STAGE_AI,
+
+    /// All of the simulation steps run in the frame, including catch-up
+    /// steps.
+    ST_STAGE_UPDATE,
+
+    /// Drawing the frame.
+    ST_STAGE_DRAW,
+
+    /// Presenting the frame, which includes any time spent waiting for
+    /// V-sync.
+    ST_STAGE_PRESENT,
+
+    /// Waiting for the frame limiter.
+    ST_STAGE_WAIT,
+
+    /// The whole frame.
+    ST_STAGE_FRAME,
+
+    /// The number of stages.
+    ST_STAGE_COUNT
+};
+
+/// A histogram of times, in nanoseconds.
+struct Histogram
+{
+    /// The number of times recorded in each bucket.
+    uint32_t counts[ST_BUCKET_COUNT];
+
+    /// The number of times recorded.
+    uint64_t total;
+
+    /// The largest time recorded.
+    uint64_t max;
+};
+
+/// The timing histograms for each stage of a frame.
+struct FrameStats
+{
+    /// The histograms, indexed by enum FrameStage.
+    struct Histogram stages[ST_STAGE_COUNT];
+};
+
+/// Clears all of the histograms.
+/// \param[out] stats   The statistics to clear.
+void st_init(struct FrameStats *stats);
+
+/// Adds a time to a histogram.
+/// \param[in,out]  histogram   The histogram.
+/// \param[in]      ns          The time, in nanoseconds.
+void st_add(struct Histogram *histogram, uint64_t ns);
+
+/// Records the time taken by a stage.
+/// \param[in,out]  stats   The statistics.
+/// \param[in]      stage   The stage.
+/// \param[in]      ns      The time taken, in nanoseconds.
+void st_record(struct FrameStats *stats, enum FrameStage stage, uint64_t ns);
+
+/// Gets a percentile from a histogram.
+/// \param[in]  histogram   The histogram.
+/// \param[in]  percent     The percentile, from 0 to 100.
+/// \returns    An upper bound on the percentile, in nanoseconds, or zero if
+///             nothing has been recorded.
+uint64_t st_percentile(const struct Histogram *histogram, double percent);
+
+/// Gets the name of a stage.
+/// \param[in]  stage   The stage.
+/// \returns    The stage's name.
+const char *st_stage_name(enum FrameStage stage);
+
+/// Writes the non-empty buckets of every histogram to a CSV file.
+/// \param[in]  stats   The statistics.
+/// \param[in]  path    The file to write.
+/// \returns    True if successful, false otherwise.
+bool st_write_csv(const struct FrameStats *stats, const char *path);
+
+#endif
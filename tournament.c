@@ -0,0 +1,563 @@
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Entry point for the headless AI tournament runner.
+
+#include "ai.h"
+#include "archive.h"
+#include "game.h"
+#include "pool.h"
+#include "replay.h"
+#include "util.h"
+#include <SDL.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/// The number of frames the simulation runs per second.
+#define FRAMES_PER_SECOND 60
+
+/// The number of frames a match may run for per point in the target score
+/// before it is abandoned as a draw, in case neither AI can score.
+#define MAX_FRAMES_PER_POINT (FRAMES_PER_SECOND * 60 * 10)
+
+/// The number of matches a worker takes at a time.
+#define MATCH_GRAIN 4
+
+/// The help text displayed when the `--help` option is provided.
+static const char * const help_text =
+"Plays AI-controlled matches without rendering and reports the results.\n"
+"\n"
+"Options:\n"
+"--matches=<count>\tSets the number of matches to play (default 1000)\n"
+"--threads=<count>\tSets the number of threads (default: one per CPU)\n"
+"--target=<score>\tSets the score that wins a match (default 11)\n"
+"--player1=<difficulty>\tSets the AI difficulty for player 1\n"
+"--player2=<difficulty>\tSets the AI difficulty for player 2\n"
+"--seed=<number>\tSets the seed of the first match\n"
+"--archive=<path>\tAppends every match's inputs to an archive\n"
+"--verify=<path>\tReplays every match in an archive instead of playing,\n"
+"\t\tand checks that each ends as recorded\n"
+"\n<difficulty> is one of:\n"
+"\teasy\n"
+"\tnormal (default)\n"
+"\thard\n"
+"\texpert\n";
+
+/// Contains user-supplied options.
+struct TournamentOptions
+{
+    /// The number of matches to play.
+    unsigned long matches;
+
+    /// The number of worker threads, or zero for one per CPU.
+    unsigned threads;
+
+    /// The score that wins a match.
+    unsigned target;
+
+    /// The seed of the first match; match \a i uses `seed + i`.
+    uint64_t seed;
+
+    /// The difficulties of the players.
+    enum AIDifficulty difficulties[PLAYER_COUNT];
+
+    /// The archive matches are appended to, or NULL.
+    const char *archive_path;
+
+    /// The archive to verify instead of playing, or NULL.
+    const char *verify_path;
+};
+
+/// The combined results of a number of matches.
+struct MatchTotals
+{
+    /// The number of matches won by each player.
+    unsigned long wins[PLAYER_COUNT];
+
+    /// The number of matches abandoned without a winner.
+    unsigned long draws;
+
+    /// The number of points scored by each player.
+    unsigned long long points[PLAYER_COUNT];
+
+    /// The number of frames simulated.
+    unsigned long long frames;
+};
+
+/// The state shared by the workers.
+struct Tournament
+{
+    /// The user-supplied options.
+    const struct TournamentOptions *options;
+
+    /// The results collected by each worker.
+    struct MatchTotals *totals;
+
+    /// The archive matches are appended to, or NULL.
+    struct ArchiveWriter *archive;
+
+    /// Protects \a archive and \a archive_failed.
+    SDL_mutex *archive_lock;
+
+    /// Whether appending a match to the archive has failed.
+    bool archive_failed;
+
+    /// Each worker's recorder, if matches are archived.
+    struct ReplayWriter *recorders;
+};
+
+/// The results of verifying part of an archive.
+struct VerifyTotals
+{
+    /// The number of matches that ended as recorded.
+    unsigned long verified;
+
+    /// The number of matches that did not.
+    unsigned long mismatched;
+
+    /// The number of matches won by each player, according to the records.
+    unsigned long wins[PLAYER_COUNT];
+
+    /// The number of ticks simulated.
+    unsigned long long ticks;
+};
+
+/// The state shared by the workers verifying an archive.
+struct Verification
+{
+    /// The archive.
+    const struct Archive *archive;
+
+    /// The results collected by each worker.
+    struct VerifyTotals *totals;
+};
+
+/// Parses the program's command line arguments.
+/// \param[in]  argc    The number of arguments.
+/// \param[in]  argv    The argument values.
+/// \returns Parsed options.
+static struct TournamentOptions parse_args(int argc, char **argv)
+{
+    struct TournamentOptions options =
+    {
+        1000,
+        0,
+        11,
+        (uint64_t)time(NULL),
+        { AI_NORMAL, AI_NORMAL },
+        NULL,
+        NULL
+    };
+    for (int i = 1; i < argc; ++i)
+    {
+        if (u_starts_with(argv[i], "--matches="))
+            options.matches = u_extract_number(
+                argv[i], 1, ULONG_MAX, "match count");
+        else if (u_starts_with(argv[i], "--threads="))
+            options.threads = (unsigned)u_extract_number(
+                argv[i], 1, 1024, "thread count");
+        else if (u_starts_with(argv[i], "--target="))
+            options.target = (unsigned)u_extract_number(
+                argv[i], 1, 99, "target score");
+        else if (u_starts_with(argv[i], "--player1="))
+            options.difficulties[0] = u_extract_difficulty(argv[i], false);
+        else if (u_starts_with(argv[i], "--player2="))
+            options.difficulties[1] = u_extract_difficulty(argv[i], false);
+        else if (u_starts_with(argv[i], "--seed="))
+            options.seed = u_extract_u64(argv[i], "seed");
+        else if (u_starts_with(argv[i], "--archive="))
+            options.archive_path = argv[i] + strlen("--archive=");
+        else if (u_starts_with(argv[i], "--verify="))
+            options.verify_path = argv[i] + strlen("--verify=");
+        else if (strcmp(argv[i], "--help") == 0)
+        {
+            puts(help_text);
+            exit(EXIT_SUCCESS);
+        }
+        else
+        {
+            fprintf(stderr, "%s: Unrecognized option '%s'\n", argv[0], argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return options;
+}
+
+/// Appends a match to the tournament's archive, or marks the archive as
+/// failed if the match could not be recorded.
+/// \param[in,out]  tournament  The tournament.
+/// \param[in]      recorder    The match's recording.
+/// \param[in]      recorded    Whether every tick was recorded.
+/// \param[in]      seed        The match's random seed.
+/// \param[in]      state       The state at the end of the match.
+static void archive_match(
+    struct Tournament *tournament,
+    struct ReplayWriter *recorder,
+    bool recorded,
+    uint64_t seed,
+    const struct GameState *state)
+{
+    // A match missing some of its ticks would fail verification, so it is
+    // left out of the archive
+    recorded = recorded && rp_finish(recorder, state);
+    SDL_LockMutex(tournament->archive_lock);
+    if (!recorded
+        || !ar_append(
+            tournament->archive,
+            seed,
+            tournament->options->difficulties,
+            state,
+            (uint32_t)recorder->ticks,
+            recorder->buffer,
+            recorder->size))
+    {
+        tournament->archive_failed = true;
+    }
+    SDL_UnlockMutex(tournament->archive_lock);
+}
+
+/// Plays one match to completion.
+/// \param[in,out]  tournament  The tournament.
+/// \param[in]      seed        The match's random seed.
+/// \param[in]      worker      The index of the calling worker.
+static void play_match(struct Tournament *tournament, uint64_t seed, unsigned worker)
+{
+    const struct TournamentOptions *options = tournament->options;
+    struct MatchTotals *totals = &tournament->totals[worker];
+    struct ReplayWriter *recorder = tournament->recorders
+        ? &tournament->recorders[worker]
+        : NULL;
+    if (recorder)
+        rp_restart(recorder);
+
+    struct GameState state;
+    g_init(&state, seed);
+    struct AIPlayer ai_players[PLAYER_COUNT];
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+        ai_init(&ai_players[i], options->difficulties[i]);
+
+    const unsigned long max_frames = MAX_FRAMES_PER_POINT * options->target;
+    unsigned long frame = 0;
+    int winner = -1;
+    bool recorded = true;
+    while (winner < 0 && frame < max_frames)
+    {
+        PlayerInput inputs[PLAYER_COUNT];
+        for (size_t i = 0; i < PLAYER_COUNT; ++i)
+            inputs[i] = ai_determine_input(&ai_players[i], &state, i);
+        if (recorder && recorded)
+            recorded = rp_record(recorder, &state, inputs);
+        g_update(&state, inputs, NULL);
+        ++frame;
+
+        for (int i = 0; i < PLAYER_COUNT; ++i)
+        {
+            if (state.players[i].score >= options->target)
+                winner = i;
+        }
+    }
+
+    if (winner >= 0)
+        ++totals->wins[winner];
+    else
+        ++totals->draws;
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+        totals->points[i] += state.players[i].score;
+    totals->frames += frame;
+    if (recorder)
+        archive_match(tournament, recorder, recorded, seed, &state);
+}
+
+/// Plays a range of matches; called by the thread pool.
+/// \param[in]  context The tournament.
+/// \param[in]  begin   The index of the first match.
+/// \param[in]  end     One past the index of the last match.
+/// \param[in]  worker  The index of the calling worker.
+static void play_matches(void *context, size_t begin, size_t end, unsigned worker)
+{
+    struct Tournament *tournament = context;
+    for (size_t i = begin; i < end; ++i)
+        play_match(tournament, tournament->options->seed + i, worker);
+}
+
+/// Replays a range of archived matches; called by the thread pool.
+/// \param[in]  context The verification.
+/// \param[in]  begin   The index of the first match.
+/// \param[in]  end     One past the index of the last match.
+/// \param[in]  worker  The index of the calling worker.
+static void verify_matches(void *context, size_t begin, size_t end, unsigned worker)
+{
+    const struct Verification *verification = context;
+    struct VerifyTotals *totals = &verification->totals[worker];
+    for (size_t i = begin; i < end; ++i)
+    {
+        struct ArchiveMatch match;
+        if (!ar_match(verification->archive, i, &match))
+        {
+            ++totals->mismatched;
+            continue;
+        }
+
+        struct ReplayReader reader;
+        rp_open_runs(
+            &reader,
+            match.seed,
+            match.difficulties,
+            match.inputs,
+            match.inputs_size);
+        struct GameState state;
+        g_init(&state, match.seed);
+        PlayerInput inputs[PLAYER_COUNT];
+        while (rp_next(&reader, inputs))
+            g_update(&state, inputs, NULL);
+        totals->ticks += reader.ticks;
+
+        uint64_t hash = rp_state_hash(&state);
+        bool matched = reader.complete
+            && reader.ticks == match.ticks
+            && hash == reader.final_hash
+            && hash == match.final_hash;
+        for (size_t player = 0; player < PLAYER_COUNT; ++player)
+        {
+            if (state.players[player].score != match.scores[player])
+                matched = false;
+        }
+        if (!matched)
+        {
+            ++totals->mismatched;
+            continue;
+        }
+        ++totals->verified;
+        if (match.scores[0] != match.scores[1])
+            ++totals->wins[match.scores[0] > match.scores[1] ? 0 : 1];
+    }
+}
+
+/// Replays every match in an archive and reports the results.
+/// \param[in]  options The user-supplied options.
+/// \param[in]  threads The number of threads to use.
+/// \returns    True if every match ended as recorded, false otherwise.
+static bool verify_archive(const struct TournamentOptions *options, unsigned threads)
+{
+    struct Archive archive;
+    if (!ar_open(&archive, options->verify_path))
+    {
+        fprintf(stderr, "Failed to open archive '%s'\n", options->verify_path);
+        return false;
+    }
+
+    struct Verification verification = { &archive, NULL };
+    verification.totals = calloc(threads, sizeof(struct VerifyTotals));
+    if (!verification.totals)
+    {
+        fprintf(stderr, "Out of memory\n");
+        ar_close(&archive);
+        return false;
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    bool successful = pool_run(
+        archive.count,
+        threads,
+        MATCH_GRAIN,
+        verify_matches,
+        &verification);
+    double seconds = (double)(SDL_GetPerformanceCounter() - start)
+        / SDL_GetPerformanceFrequency();
+    if (!successful)
+    {
+        fprintf(stderr, "Failed to start worker threads: %s\n", SDL_GetError());
+        free(verification.totals);
+        ar_close(&archive);
+        return false;
+    }
+
+    struct VerifyTotals totals = { 0, 0, {0}, 0 };
+    for (unsigned w = 0; w < threads; ++w)
+    {
+        totals.verified += verification.totals[w].verified;
+        totals.mismatched += verification.totals[w].mismatched;
+        for (size_t i = 0; i < PLAYER_COUNT; ++i)
+            totals.wins[i] += verification.totals[w].wins[i];
+        totals.ticks += verification.totals[w].ticks;
+    }
+    free(verification.totals);
+
+    printf("Matches:    %lu in '%s'\n",
+        (unsigned long)archive.count,
+        options->verify_path);
+    printf("Verified:   %lu\n", totals.verified);
+    printf("Mismatched: %lu\n", totals.mismatched);
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+        printf("Player %u:   %lu wins\n", (unsigned)i + 1u, totals.wins[i]);
+    printf("Elapsed:    %.3f s\n", seconds);
+    if (seconds > 0.0)
+    {
+        printf("Throughput: %.1f matches/s, %.0f frames/s\n",
+            archive.count / seconds,
+            totals.ticks / seconds);
+    }
+    ar_close(&archive);
+    return totals.mismatched == 0;
+}
+
+/// Prints the results of a tournament.
+/// \param[in]  options The tournament options.
+/// \param[in]  totals  The combined results.
+/// \param[in]  seconds The time taken to play the matches.
+static void print_results(
+    const struct TournamentOptions *options,
+    const struct MatchTotals *totals,
+    double seconds)
+{
+    printf("Matches:    %lu (%s vs %s, first to %u, seed %llu)\n",
+        options->matches,
+        ai_difficulty_name(options->difficulties[0]),
+        ai_difficulty_name(options->difficulties[1]),
+        options->target,
+        (unsigned long long)options->seed);
+    for (size_t i = 0; i < PLAYER_COUNT; ++i)
+    {
+        printf("Player %u:   %lu wins (%.1f%%), %llu points\n",
+            (unsigned)i + 1u,
+            totals->wins[i],
+            100.0 * totals->wins[i] / options->matches,
+            totals->points[i]);
+    }
+    printf("Draws:      %lu\n", totals->draws);
+    printf("Elapsed:    %.3f s\n", seconds);
+    if (seconds > 0.0)
+    {
+        double frames_per_second = totals->frames / seconds;
+        printf("Throughput: %.1f matches/s, %.0f frames/s (%.0fx real time)\n",
+            options->matches / seconds,
+            frames_per_second,
+            frames_per_second / FRAMES_PER_SECOND);
+    }
+}
+
+/// Program entry point.
+/// \param[in]  argc    The number of arguments.
+/// \param[in]  argv    The argument values.
+/// \returns    The exit status.
+int main(int argc, char **argv)
+{
+    struct TournamentOptions options = parse_args(argc, argv);
+    unsigned threads = options.threads
+        ? options.threads
+        : pool_default_threads();
+    if (options.verify_path)
+        return verify_archive(&options, threads) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    struct Tournament tournament = { &options, NULL, NULL, NULL, false, NULL };
+    tournament.totals = calloc(threads, sizeof(struct MatchTotals));
+    if (!tournament.totals)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    struct ArchiveWriter archive;
+    bool successful = true;
+    if (options.archive_path)
+    {
+        if (!ar_create(&archive, options.archive_path))
+        {
+            fprintf(stderr, "Failed to open archive '%s'\n", options.archive_path);
+            free(tournament.totals);
+            return EXIT_FAILURE;
+        }
+        tournament.archive = &archive;
+        tournament.archive_lock = SDL_CreateMutex();
+        tournament.recorders = calloc(threads, sizeof(struct ReplayWriter));
+        if (!tournament.archive_lock || !tournament.recorders)
+        {
+            fprintf(stderr, "Out of memory\n");
+            tournament.archive_failed = true;
+            successful = false;
+        }
+        else
+        {
+            for (unsigned w = 0; w < threads; ++w)
+                rp_init_memory(&tournament.recorders[w]);
+        }
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    bool played = successful
+        && pool_run(
+            options.matches,
+            threads,
+            MATCH_GRAIN,
+            play_matches,
+            &tournament);
+    Uint64 finish = SDL_GetPerformanceCounter();
+    if (successful && !played)
+    {
+        fprintf(stderr, "Failed to start worker threads: %s\n", SDL_GetError());
+        successful = false;
+    }
+
+    // The archive is finished however the tournament ended, so that it is
+    // left with a valid index
+    if (tournament.archive)
+    {
+        if (tournament.recorders)
+        {
+            for (unsigned w = 0; w < threads; ++w)
+                rp_free(&tournament.recorders[w]);
+            free(tournament.recorders);
+        }
+        if (tournament.archive_lock)
+            SDL_DestroyMutex(tournament.archive_lock);
+        if (!ar_finish(&archive) || tournament.archive_failed)
+        {
+            fprintf(stderr, "Failed to write archive '%s'\n", options.archive_path);
+            successful = false;
+        }
+    }
+    if (!played)
+    {
+        free(tournament.totals);
+        return EXIT_FAILURE;
+    }
+
+    struct MatchTotals totals = { {0}, 0, {0}, 0 };
+    for (unsigned w = 0; w < threads; ++w)
+    {
+        for (size_t i = 0; i < PLAYER_COUNT; ++i)
+        {
+            totals.wins[i] += tournament.totals[w].wins[i];
+            totals.points[i] += tournament.totals[w].points[i];
+        }
+        totals.draws += tournament.totals[w].draws;
+        totals.frames += tournament.totals[w].frames;
+    }
+    free(tournament.totals);
+
+    double seconds = (double)(finish - start) / SDL_GetPerformanceFrequency();
+    print_results(&options, &totals, seconds);
+    return successful ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -21,6 +21,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "util.h"
 #include <SDL.h>
+#include <errno.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -58,3 +59,55 @@ void u_display_sdl_error(void)
         fprintf(stderr, "SDL error: %s\n", msg);
     }
 }
+
+bool u_starts_with(const char *str, const char *prefix)
+{
+    size_t prefix_len = strlen(prefix);
+    return strncmp(str, prefix, prefix_len) == 0;
+}
+
+unsigned long u_extract_number(
+    const char *arg,
+    unsigned long min,
+    unsigned long max,
+    const char *what)
+{
+    const char *value = strchr(arg, '=') + 1;
+    char *end;
+    errno = 0;
+    unsigned long number = strtoul(value, &end, 10);
+    if (*value < '0' || *value > '9' || *end != '\0' || errno == ERANGE
+        || number < min || number > max)
+    {
+        fprintf(stderr, "Invalid %s '%s'\n", what, value);
+        exit(EXIT_FAILURE);
+    }
+    return number;
+}
+
+uint64_t u_extract_u64(const char *arg, const char *what)
+{
+    const char *value = strchr(arg, '=') + 1;
+    char *end;
+    errno = 0;
+    unsigned long long number = strtoull(value, &end, 10);
+    if (*value < '0' || *value > '9' || *end != '\0' || errno == ERANGE)
+    {
+        fprintf(stderr, "Invalid %s '%s'\n", what, value);
+        exit(EXIT_FAILURE);
+    }
+    return (uint64_t)number;
+}
+
+enum AIDifficulty u_extract_difficulty(const char *arg, bool allow_none)
+{
+    const char *value = strchr(arg, '=') + 1;
+    enum AIDifficulty difficulty;
+    if (!ai_parse_difficulty(value, &difficulty)
+        || (!allow_none && difficulty == AI_NONE))
+    {
+        fprintf(stderr, "Unrecognized difficulty '%s'\n", value);
+        exit(EXIT_FAILURE);
+    }
+    return difficulty;
+}
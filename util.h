@@ -22,6 +22,10 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 /// \file
 /// \brief Common utility functions.
 
+#include "ai.h"
+#include <stdbool.h>
+#include <stdint.h>
+
 /// Displays an error message in a dialog box with the given title.
 /// \param[in]  message The error message.
 /// \param[in]  title   The dialog box's title.
@@ -30,4 +34,37 @@ void u_display_error(const char *message, const char *title);
 /// Displays the current SDL error in a dialog box.
 void u_display_sdl_error(void);
 
+/// Determines if a string begins with a prefix.
+/// \param[in]  str     The string to search.
+/// \param[in]  prefix  The string to search for.
+/// \returns    Whether the string begins with the prefix.
+bool u_starts_with(const char *str, const char *prefix);
+
+/// Gets the number after the equals sign in a command line option, exiting
+/// with an error message if it is missing, malformed or out of range.
+/// \param[in]  arg     The argument text.
+/// \param[in]  min     The lowest accepted value.
+/// \param[in]  max     The highest accepted value.
+/// \param[in]  what    What the number is, for the error message.
+/// \returns    The parsed number.
+unsigned long u_extract_number(
+    const char *arg,
+    unsigned long min,
+    unsigned long max,
+    const char *what);
+
+/// Gets the 64-bit number after the equals sign in a command line option,
+/// exiting with an error message if it is missing, malformed or too large.
+/// \param[in]  arg     The argument text.
+/// \param[in]  what    What the number is, for the error message.
+/// \returns    The parsed number.
+uint64_t u_extract_u64(const char *arg, const char *what);
+
+/// Gets the AI difficulty after the equals sign in a command line option,
+/// exiting with an error message if it is not recognized.
+/// \param[in]  arg         The argument text.
+/// \param[in]  allow_none  Whether "none", for a human player, is accepted.
+/// \returns    The parsed difficulty.
+enum AIDifficulty u_extract_difficulty(const char *arg, bool allow_none);
+
 #endif
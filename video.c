@@ -0,0 +1,333 @@
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Implementation of the video module.
+///
+/// The frame buffers form a ring. The caller fills them in order, and the
+/// writer thread converts and writes them in the same order, reusing one
+/// conversion buffer, so nothing is allocated per frame.
+
+#include "video.h"
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+/// The number of frame buffers. More lets the caller run further ahead of
+/// the writer when writing stalls briefly.
+#define BUFFER_COUNT 4
+
+struct VideoWriter
+{
+    /// The output.
+    FILE *file;
+
+    /// The format written.
+    enum VideoFormat format;
+
+    /// The width of each frame, in pixels.
+    int width;
+
+    /// The height of each frame, in pixels.
+    int height;
+
+    /// The frame buffers.
+    uint32_t *buffers[BUFFER_COUNT];
+
+    /// The converted frame, which is written in one call.
+    unsigned char *output;
+
+    /// The size of \a output, in bytes.
+    size_t output_size;
+
+    /// Protects the fields below.
+    SDL_mutex *lock;
+
+    /// Signalled when a frame is queued, or the writer is closed.
+    SDL_cond *queued_cond;
+
+    /// Signalled when a frame has been written.
+    SDL_cond *written_cond;
+
+    /// The index of the next buffer for the caller to fill.
+    size_t head;
+
+    /// The number of frames queued for the writer thread, including one that
+    /// is being written.
+    size_t queued;
+
+    /// Whether no more frames will be queued.
+    bool closing;
+
+    /// Whether writing has failed.
+    bool failed;
+
+    /// The writer thread.
+    SDL_Thread *thread;
+};
+
+bool vid_parse_format(const char *name, enum VideoFormat *format)
+{
+    if (strcmp(name, "y4m") == 0)
+        *format = VID_FORMAT_Y4M;
+    else if (strcmp(name, "rgba") == 0)
+        *format = VID_FORMAT_RGBA;
+    else
+        return false;
+    return true;
+}
+
+/// Converts a frame to BT.601 limited range Y, U and V planes. The colours
+/// of the game are all greys, but any colour is converted correctly.
+/// \param[in]  pixels  The frame.
+/// \param[in]  count   The number of pixels.
+/// \param[out] planes  Receives the Y plane, followed by U and V.
+static void convert_y4m(const uint32_t *pixels, size_t count, unsigned char *planes)
+{
+    unsigned char *y_plane = planes;
+    unsigned char *u_plane = planes + count;
+    unsigned char *v_plane = planes + count * 2;
+    for (size_t i = 0; i < count; ++i)
+    {
+        int r = (int)(pixels[i] >> 16 & 0xFF);
+        int g = (int)(pixels[i] >> 8 & 0xFF);
+        int b = (int)(pixels[i] & 0xFF);
+        // The chroma sums can be negative, and shifting a negative number
+        // right is implementation-defined, so the +128 offset is added
+        // before the shift, which keeps them positive
+        y_plane[i] = (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        u_plane[i] = (unsigned char)((-38 * r - 74 * g + 112 * b + 128 + (128 << 8)) >> 8);
+        v_plane[i] = (unsigned char)((112 * r - 94 * g - 18 * b + 128 + (128 << 8)) >> 8);
+    }
+}
+
+/// Converts a frame to R, G, B and A bytes.
+/// \param[in]  pixels  The frame.
+/// \param[in]  count   The number of pixels.
+/// \param[out] bytes   Receives the bytes.
+static void convert_rgba(const uint32_t *pixels, size_t count, unsigned char *bytes)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        bytes[i * 4] = (unsigned char)(pixels[i] >> 16);
+        bytes[i * 4 + 1] = (unsigned char)(pixels[i] >> 8);
+        bytes[i * 4 + 2] = (unsigned char)pixels[i];
+        bytes[i * 4 + 3] = (unsigned char)(pixels[i] >> 24);
+    }
+}
+
+/// Converts and writes one frame.
+/// \param[in]  writer  The writer.
+/// \param[in]  pixels  The frame.
+/// \returns    True if successful, false otherwise.
+static bool write_frame(struct VideoWriter *writer, const uint32_t *pixels)
+{
+    size_t count = (size_t)writer->width * (size_t)writer->height;
+    if (writer->format == VID_FORMAT_Y4M)
+    {
+        if (fputs("FRAME\n", writer->file) == EOF)
+            return false;
+        convert_y4m(pixels, count, writer->output);
+    }
+    else
+    {
+        convert_rgba(pixels, count, writer->output);
+    }
+    return fwrite(writer->output, 1, writer->output_size, writer->file)
+        == writer->output_size;
+}
+
+/// Writes queued frames until the writer is closed.
+/// \param[in]  data    The writer.
+/// \returns    Zero.
+static int writer_main(void *data)
+{
+    struct VideoWriter *writer = data;
+    size_t tail = 0;
+    SDL_LockMutex(writer->lock);
+    for (;;)
+    {
+        while (writer->queued == 0 && !writer->closing)
+            SDL_CondWait(writer->queued_cond, writer->lock);
+        if (writer->queued == 0)
+            break;
+
+        // The caller never touches a queued buffer, so it is written unlocked
+        SDL_UnlockMutex(writer->lock);
+        bool written = !writer->failed
+            && write_frame(writer, writer->buffers[tail]);
+        tail = (tail + 1) % BUFFER_COUNT;
+        SDL_LockMutex(writer->lock);
+
+        if (!written)
+            writer->failed = true;
+        --writer->queued;
+        SDL_CondSignal(writer->written_cond);
+    }
+    SDL_UnlockMutex(writer->lock);
+    return 0;
+}
+
+/// Frees a writer's resources, except for its thread.
+/// \param[in]  writer  The writer.
+/// \returns    True if the output was closed successfully, false otherwise.
+static bool free_writer(struct VideoWriter *writer)
+{
+    bool successful = true;
+    if (writer->file && writer->file != stdout)
+        successful = fclose(writer->file) == 0;
+    else if (writer->file)
+        successful = fflush(writer->file) == 0;
+    for (size_t i = 0; i < BUFFER_COUNT; ++i)
+        free(writer->buffers[i]);
+    free(writer->output);
+    if (writer->written_cond)
+        SDL_DestroyCond(writer->written_cond);
+    if (writer->queued_cond)
+        SDL_DestroyCond(writer->queued_cond);
+    if (writer->lock)
+        SDL_DestroyMutex(writer->lock);
+    free(writer);
+    return successful;
+}
+
+struct VideoWriter *vid_open(
+    const char *path,
+    enum VideoFormat format,
+    int width,
+    int height,
+    unsigned fps)
+{
+    struct VideoWriter *writer = calloc(1, sizeof(struct VideoWriter));
+    if (!writer)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Out of memory");
+        return NULL;
+    }
+    writer->format = format;
+    writer->width = width;
+    writer->height = height;
+
+    if (strcmp(path, "-") == 0)
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        writer->file = stdout;
+    }
+    else
+    {
+        writer->file = fopen(path, "wb");
+        if (!writer->file)
+        {
+            SDL_LogError(
+                SDL_LOG_CATEGORY_APPLICATION,
+                "Failed to open '%s' for writing",
+                path);
+            free_writer(writer);
+            return NULL;
+        }
+    }
+
+    size_t pixel_count = (size_t)width * (size_t)height;
+    writer->output_size = pixel_count * (format == VID_FORMAT_Y4M ? 3 : 4);
+    writer->output = malloc(writer->output_size);
+    bool allocated = writer->output != NULL;
+    for (size_t i = 0; i < BUFFER_COUNT; ++i)
+    {
+        writer->buffers[i] = malloc(pixel_count * sizeof(uint32_t));
+        allocated = allocated && writer->buffers[i];
+    }
+    if (!allocated)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Out of memory");
+        free_writer(writer);
+        return NULL;
+    }
+
+    if (format == VID_FORMAT_Y4M
+        && fprintf(
+            writer->file,
+            "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C444\n",
+            width,
+            height,
+            fps) < 0)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to write video header");
+        free_writer(writer);
+        return NULL;
+    }
+
+    writer->lock = SDL_CreateMutex();
+    writer->queued_cond = SDL_CreateCond();
+    writer->written_cond = SDL_CreateCond();
+    if (writer->lock && writer->queued_cond && writer->written_cond)
+        writer->thread = SDL_CreateThread(writer_main, "video writer", writer);
+    if (!writer->thread)
+    {
+        SDL_LogError(
+            SDL_LOG_CATEGORY_APPLICATION,
+            "Failed to start video writer: %s",
+            SDL_GetError());
+        free_writer(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+uint32_t *vid_begin_frame(struct VideoWriter *writer)
+{
+    SDL_LockMutex(writer->lock);
+    while (writer->queued == BUFFER_COUNT && !writer->failed)
+        SDL_CondWait(writer->written_cond, writer->lock);
+    bool failed = writer->failed;
+    SDL_UnlockMutex(writer->lock);
+    return failed ? NULL : writer->buffers[writer->head];
+}
+
+void vid_end_frame(struct VideoWriter *writer)
+{
+    writer->head = (writer->head + 1) % BUFFER_COUNT;
+    SDL_LockMutex(writer->lock);
+    ++writer->queued;
+    SDL_CondSignal(writer->queued_cond);
+    SDL_UnlockMutex(writer->lock);
+}
+
+bool vid_close(struct VideoWriter *writer)
+{
+    SDL_LockMutex(writer->lock);
+    writer->closing = true;
+    SDL_CondSignal(writer->queued_cond);
+    SDL_UnlockMutex(writer->lock);
+    SDL_WaitThread(writer->thread, NULL);
+
+    bool successful = !writer->failed;
+    if (!free_writer(writer))
+        successful = false;
+    if (!successful)
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to write video");
+    return successful;
+}
@@ -0,0 +1,81 @@
+#ifndef VIDEO_H
+#define VIDEO_H
+
+/*
+table_tennis - A simple two player game
+Copyright (C) 2021  Eric Sundell
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/// \file
+/// \brief Functionality exported by the video module.
+///
+/// Frames are rasterized by the caller into buffers owned by the writer, and
+/// converted and written to the output by a background thread, so that the
+/// caller only waits when every buffer is queued.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// The formats a video can be written in.
+enum VideoFormat
+{
+    /// YUV4MPEG2 with 4:4:4 chroma, which ffmpeg and most players accept.
+    VID_FORMAT_Y4M,
+
+    /// Headerless frames of 8-bit R, G, B and A bytes.
+    VID_FORMAT_RGBA
+};
+
+/// Writes frames to a file or standard output.
+struct VideoWriter;
+
+/// Parses the name of a video format.
+/// \param[in]  name    The name: "y4m" or "rgba".
+/// \param[out] format  Receives the format.
+/// \returns    True if the name was recognized, false otherwise.
+bool vid_parse_format(const char *name, enum VideoFormat *format);
+
+/// Opens a video and starts its writer thread.
+/// \param[in]  path    The file to write to, or "-" for standard output.
+/// \param[in]  format  The format to write.
+/// \param[in]  width   The width of each frame, in pixels.
+/// \param[in]  height  The height of each frame, in pixels.
+/// \param[in]  fps     The frame rate recorded in the header.
+/// \returns    The writer, or NULL on failure.
+struct VideoWriter *vid_open(
+    const char *path,
+    enum VideoFormat format,
+    int width,
+    int height,
+    unsigned fps);
+
+/// Gets a buffer to draw the next frame into, waiting for the writer thread
+/// to free one if necessary. The buffer holds \a width * \a height pixels in
+/// the framebuffer module's format, and its previous contents are undefined.
+/// \param[in]  writer  The writer.
+/// \returns    The buffer, or NULL if writing has failed.
+uint32_t *vid_begin_frame(struct VideoWriter *writer);
+
+/// Queues the frame drawn into the buffer from vid_begin_frame().
+/// \param[in]  writer  The writer.
+void vid_end_frame(struct VideoWriter *writer);
+
+/// Writes the queued frames, stops the writer thread and closes the output.
+/// \param[in]  writer  The writer, which is freed.
+/// \returns    True if every frame was written, false otherwise.
+bool vid_close(struct VideoWriter *writer);
+
+#endif